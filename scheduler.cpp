@@ -1,16 +1,52 @@
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
+#include <cmath>
+#include <cctype>
+#include <cstdarg>
 #include <unistd.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <iostream>
 #include <fstream>
 #include <vector>
-#include <deque>
-#include <map>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <type_traits>
+#include <stdexcept>
+
+#include "scheduler.h"
+
+/** everything but what scheduler.h names has internal linkage **/
+namespace {
 
 using namespace std;
 
+/**
+ * Report an unreadable file, an invalid spec or a broken invariant. The
+ * library hands the message to the caller, the command line prints it and
+ * exits.
+ * @param - format - printf format of the message, without the newline
+ */
+[[noreturn]] void throw_error(const char *format, ...) {
+    char message[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    throw runtime_error(message);
+}
+
 enum Transitions {
     TRANS_TO_BLOCK,
     TRANS_TO_DONE,
@@ -27,853 +63,5068 @@ enum Proc_State {
     RUNNING
 };
 
-class Process {
+/**
+ * Growable ring buffer with the deque interface used by the run queues.
+ * Capacity is only ever grown, so a queue that cycles elements in steady
+ * state never allocates (std::deque frees and allocates blocks as it moves).
+ */
+template<typename T>
+class Ring {
 private:
-    static int process_count;
-    int pid;
+    vector<T> buffer; // capacity is always a power of two
+    size_t head = 0;  // index of the front element
+    size_t count = 0;
+
+    void grow() {
+        vector<T> bigger(buffer.empty() ? 16 : buffer.size() * 2);
+        for (size_t i = 0; i < count; i++)
+            bigger[i] = (*this)[i];
+        buffer.swap(bigger);
+        head = 0;
+    }
 
 public:
-    int arrival_time, total_cpu_time, cpu_burst, io_burst;
-    int state_start_time;   // used to calculate time spent in state
-    int curr_cpu_burst;     // time remaining in current cpu burst
-    int remaining_cpu_time; // time remaining in total cpu time
-    int finishing_time;     // time when the process finished
-    int io_time;            // time spent in blocked state
-    int cpu_wait_time;      // time spent in ready state
-    int static_priority;    // static priority
-    int dynamic_priority;   // dynamic priority
-    Proc_State state;       // current
+    [[nodiscard]] bool empty() const {
+        return count == 0;
+    }
 
-    explicit Process(const string &args) {
-        arrival_time = total_cpu_time = cpu_burst = io_burst = 0;
-        pid = Process::process_count++;
-        char *buffer = new char[args.length() + 1];
-        strcpy(buffer, args.c_str());
+    [[nodiscard]] size_t size() const {
+        return count;
+    }
 
-        sscanf(buffer, "%d %d %d %d", &arrival_time, &total_cpu_time, &cpu_burst, &io_burst);
-        delete[] buffer;
+    [[nodiscard]] size_t capacity() const {
+        return buffer.size();
+    }
 
-        /** default initialization **/
-        state = CREATED;
-        state_start_time = arrival_time;
-        remaining_cpu_time = total_cpu_time;
-        curr_cpu_burst = 0;
-        io_time = 0;
-        cpu_wait_time = 0;
-        finishing_time = arrival_time;
-        static_priority = 1;
-        dynamic_priority = 0;
+    T &operator[](size_t i) {
+        return buffer[(head + i) & (buffer.size() - 1)];
     }
 
-    [[nodiscard]] int get_pid() const {
-        return pid;
+    T &front() {
+        return buffer[head];
     }
-};
 
-class Event {
-public:
-    Process *process;
-    int timestamp;
-    Transitions transition;
+    T &back() {
+        return (*this)[count - 1];
+    }
+
+    void push_front(const T &value) {
+        if (count == buffer.size())
+            grow();
+        head = (head - 1) & (buffer.size() - 1);
+        buffer[head] = value;
+        count++;
+    }
+
+    void push_back(const T &value) {
+        if (count == buffer.size())
+            grow();
+        count++;
+        back() = value;
+    }
+
+    void pop_front() {
+        head = (head + 1) & (buffer.size() - 1);
+        count--;
+    }
+
+    void pop_back() {
+        count--;
+    }
 
-    explicit Event(Process *p) {
-        process = p;
+    /** drop every element, the capacity is kept **/
+    void clear() {
+        head = 0;
+        count = 0;
     }
 };
 
-class DES_Layer {
+/**
+ * One line of the input file
+ */
+struct ProcessSpec {
+    int arrival_time;
+    int total_cpu_time;
+    int cpu_burst;
+    int io_burst;
+};
+
+/**
+ * Read-only memory mapping of a whole file
+ */
+class MappedFile {
 private:
-    deque<Event *> eventQ;
+    const char *data = nullptr;
+    size_t length = 0;
+
 public:
+    MappedFile() = default;
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
 
     /**
-     * Add the created processes to the Event Queue
+     * Map a file, an empty file maps to an empty range
+     * @param - filename - file to map
+     *
+     * @returns - false if the file cannot be opened or mapped
      */
-    void initialize(const vector<Process *> &processes) {
-        for (Process *p: processes) {
-            auto *e = new Event(p);
-            e->timestamp = p->arrival_time;
-            e->transition = TRANS_TO_READY;
-            put_event(e);
+    bool open(const char *filename) {
+        int fd = ::open(filename, O_RDONLY);
+        if (fd < 0) {
+            return false;
         }
-    }
-
-    Event *get_event() {
-        if (eventQ.empty()) {
-            return nullptr;
+        struct stat st{};
+        if (fstat(fd, &st) < 0) {
+            close(fd);
+            return false;
         }
-        Event *e = eventQ.back();
-        eventQ.pop_back();
-        return e;
-    }
-
-    int get_next_event_time() {
-        if (eventQ.empty()) {
-            return -1;
+        length = st.st_size;
+        if (length > 0) {
+            void *m = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (m == MAP_FAILED) {
+                close(fd);
+                length = 0;
+                return false;
+            }
+            madvise(m, length, MADV_SEQUENTIAL);
+            data = static_cast<const char *>(m);
         }
-        return eventQ.back()->timestamp;
+        close(fd);
+        return true;
     }
 
-    void put_event(Event *e) {
-        eventQ.push_front(e);
-        if (eventQ.size() == 1) {
-            return;
-        }
-
-        Event *evt = eventQ[0];
-        int j = 1;
-        while (j < eventQ.size() && evt->timestamp < eventQ[j]->timestamp) {
-            eventQ[j - 1] = eventQ[j];
-            j = j + 1;
-        }
-        eventQ[j - 1] = evt;
+    /**
+     * Replace the access pattern hint given to the kernel at open
+     */
+    void advise(int advice) {
+        if (data)
+            madvise((void *) data, length, advice);
     }
 
-    bool has_pending_events(Process *process, int time) {
-        int i = (int) eventQ.size() - 1;
-        while (i >= 0) {
-            Process *p = eventQ[i]->process;
-            if (p->get_pid() == process->get_pid() && eventQ[i]->timestamp == time) {
-                return true;
-            }
-            i--;
-        }
-        return false;
+    [[nodiscard]] const char *begin() const {
+        return data;
     }
 
-    void remove_events(Process *process, int now) {
+    [[nodiscard]] const char *end() const {
+        return data + length;
+    }
 
-        auto itr = eventQ.begin();
-        while (itr != eventQ.end()) {
-            Event *e = *itr;
-            if (e->process->get_pid() == process->get_pid() && e->timestamp != now) {
-                itr = eventQ.erase(itr);
-                delete e;
-            } else {
-                // move to next element
-                ++itr;
-            }
-        }
+    ~MappedFile() {
+        if (data)
+            munmap((void *) data, length);
     }
 };
 
-class Scheduler {
-protected:
-    int quantum;
-    int max_priority;
+/**
+ * Layout of a precompiled workload file (all fields little-endian):
+ * this header, rand_count int32 random values, then process_count
+ * ProcessSpec records of four int32 each
+ */
+struct BinaryHeader {
+    char magic[8];          // BINARY_MAGIC
+    uint32_t version;       // BINARY_VERSION
+    uint32_t rand_count;    // random values following the header
+    uint64_t process_count; // ProcessSpec records following the random values
+    int64_t input_mtime;    // modification time (ns) and size of the text files
+    int64_t input_size;     // the binary was built from, used to validate caches
+    int64_t rand_mtime;
+    int64_t rand_size;
+    uint64_t reserved;
+};
 
-public:
-    explicit Scheduler(int q = 10000, int maxprio = 4) {
-        quantum = q;
-        max_priority = maxprio;
-    }
+const char BINARY_MAGIC[8] = {'S', 'C', 'H', 'E', 'D', 'B', 'I', 'N'};
+const uint32_t BINARY_VERSION = 1;
 
-    virtual void add_process(Process *p) = 0;
+static_assert(sizeof(ProcessSpec) == 4 * sizeof(int32_t), "ProcessSpec must be four packed int32");
+static_assert(sizeof(BinaryHeader) == 64, "BinaryHeader must be 64 bytes");
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "binary workloads are mapped in place on little-endian hosts");
 
-    virtual Process *get_next_process() = 0;
+class BurstTrace;
 
-    virtual string to_string() = 0;
+}  // namespace
 
-    virtual bool test_preempt(Process *activated_proc, Process *curr_proc, DES_Layer *dispatcher, int curr_time) = 0;
+/**
+ * Parsed input and random-number files, shared read-only by every simulation.
+ * The arrays are either owned (parsed from text) or point straight into a
+ * mapped binary workload file.
+ */
+class Workload {
+private:
+    vector<int> rand_storage;            // backing store when parsed from text
+    vector<ProcessSpec> process_storage;
+    MappedFile mapping;                  // backing store when loaded from a binary file
 
-    [[nodiscard]] int get_maxprio() const {
-        return max_priority;
-    }
+public:
+    const int *randvals = nullptr;          // numbers of the random-number file
+    size_t rand_count = 0;
+    const ProcessSpec *processes = nullptr; // lines of the input file
+    size_t process_count = 0;
+    const BurstTrace *replay = nullptr;     // -r: recorded bursts replacing the random burst draws
+    string arrival_input;                   // -A on a text input: processes is empty, runs read them from this file
 
-    [[nodiscard]] int get_quant() const {
-        return quantum;
-    }
+    Workload() = default;
 
-    virtual ~Scheduler() = default;
-};
+    Workload(const Workload &) = delete;
 
-class FCFSScheduler : public Scheduler {
-private:
-    deque<Process *> runQ;
+    Workload &operator=(const Workload &) = delete;
 
-public:
-    void add_process(Process *p) override {
-        runQ.push_front(p);
+    int *resize_randvals(size_t n) {
+        rand_storage.resize(n);
+        randvals = rand_storage.data();
+        rand_count = n;
+        return rand_storage.data();
     }
 
-    Process *get_next_process() override {
-        if (runQ.empty()) {
-            return nullptr;
-        }
-        Process *p = runQ.back();
-        runQ.pop_back();
-        return p;
+    ProcessSpec *resize_processes(size_t n) {
+        process_storage.resize(n);
+        processes = process_storage.data();
+        process_count = n;
+        return process_storage.data();
     }
 
-    bool test_preempt(Process *activated_proc, Process *curr_proc, DES_Layer *dispatcher, int curr_time) override {
-        return false;
+    void add_process(const ProcessSpec &spec) {
+        process_storage.push_back(spec);
+        processes = process_storage.data();
+        process_count = process_storage.size();
     }
 
-    string to_string() override {
-        return "FCFS";
+    /**
+     * Map a binary workload file and point the arrays into it, nothing is parsed or copied
+     * @param - filename - binary workload file
+     * @param - header - receives a copy of the file header
+     *
+     * @returns - false if the file is missing, truncated or not a binary workload
+     */
+    bool map_binary(const char *filename, BinaryHeader &header) {
+        if (!mapping.open(filename)) {
+            return false;
+        }
+        size_t length = mapping.end() - mapping.begin();
+        if (length < sizeof(BinaryHeader)) {
+            return false;
+        }
+        memcpy(&header, mapping.begin(), sizeof(BinaryHeader));
+        if (memcmp(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0 || header.version != BINARY_VERSION ||
+            header.rand_count == 0) {
+            return false;
+        }
+        size_t expected = sizeof(BinaryHeader) + header.rand_count * sizeof(int32_t) +
+                          header.process_count * sizeof(ProcessSpec);
+        if (length != expected) {
+            return false;
+        }
+        randvals = reinterpret_cast<const int *>(mapping.begin() + sizeof(BinaryHeader));
+        rand_count = header.rand_count;
+        processes = reinterpret_cast<const ProcessSpec *>(randvals + rand_count);
+        process_count = header.process_count;
+        return true;
     }
 };
 
-class LCFSScheduler : public Scheduler {
+namespace {
+
+/**
+ * Scheduling state of a process: the fields the event loop and the run
+ * queues touch on every transition, kept small so the table stays in cache
+ */
+class Process {
 private:
-    deque<Process *> runQ;
+    int pid;
+    int slot;               // index in the ProcessTable, equal to pid unless arrivals are streamed
 
 public:
-    void add_process(Process *p) override {
-        runQ.push_front(p);
-    }
+    int cpu_burst, io_burst;
+    int state_start_time;   // used to calculate time spent in state
+    int curr_cpu_burst;     // time remaining in current cpu burst
+    int remaining_cpu_time; // time remaining in total cpu time
+    int static_priority;    // static priority
+    int dynamic_priority;   // dynamic priority
+    int cpu;                // CPU the process runs or last ran on, -1 before its first dispatch
+    Proc_State state;       // current
 
-    Process *get_next_process() override {
-        if (runQ.empty()) {
-            return nullptr;
-        }
-        Process *p = runQ.front();
-        runQ.pop_front();
-        return p;
+    Process(int id, int index, const ProcessSpec &spec) {
+        pid = id;
+        slot = index;
+        cpu_burst = spec.cpu_burst;
+        io_burst = spec.io_burst;
+
+        /** default initialization **/
+        state = CREATED;
+        state_start_time = spec.arrival_time;
+        remaining_cpu_time = spec.total_cpu_time;
+        curr_cpu_burst = 0;
+        static_priority = 1;
+        dynamic_priority = 0;
+        cpu = -1;
     }
 
-    bool test_preempt(Process *activated_proc, Process *curr_proc, DES_Layer *dispatcher, int curr_time) override {
-        return false;
+    [[nodiscard]] int get_pid() const {
+        return pid;
     }
 
-    string to_string() override {
-        return "LCFS";
+    [[nodiscard]] int get_slot() const {
+        return slot;
     }
 };
 
-class SRTFScheduler : public Scheduler {
+/**
+ * Process store indexed by slot, laid out as a struct of arrays: Process
+ * records hold the hot scheduling state, while the accounting that is only
+ * updated at transitions and read by the report lives in one array per
+ * field so the summary reductions stream through contiguous ints.
+ * Process records sit in fixed-size blocks, so pointers stay valid while
+ * the table grows. A slot is the pid, unless arrivals are streamed: then
+ * finished processes release their slot for the next arrival.
+ */
+class ProcessTable {
 private:
-    deque<Process *> runQ;
+    friend class SnapshotWriter;
+    friend class SnapshotReader;
+
+    static const size_t BLOCK = 4096;  // Process records per block
+    vector<vector<Process>> blocks;
+    vector<int> free_slots;            // released slots, reused by admit
+    size_t slots = 0;
 
 public:
-    void add_process(Process *p) override {
-        runQ.push_front(p);
-        if (runQ.size() == 1) {
-            return;
-        }
+    vector<int> arrival_time;   // time the process enters the system
+    vector<int> total_cpu_time; // total cpu time required
+    vector<int> finishing_time; // time when the process finished
+    vector<int> io_time;        // time spent in blocked state
+    vector<int> cpu_wait_time;  // time spent in ready state
+    vector<int> response_time;  // time from arrival to the first dispatch, -1 before it
 
-        Process *proc = runQ[0];
-        int j = 1;
-        while (j < runQ.size() && proc->remaining_cpu_time < runQ[j]->remaining_cpu_time) {
-            runQ[j - 1] = runQ[j];
-            j = j + 1;
+    /**
+     * Size the table for n processes, pointers returned by get stay valid afterwards
+     */
+    void reserve(size_t n) {
+        blocks.reserve((n + BLOCK - 1) / BLOCK);
+        arrival_time.reserve(n);
+        total_cpu_time.reserve(n);
+        finishing_time.reserve(n);
+        io_time.reserve(n);
+        cpu_wait_time.reserve(n);
+        response_time.reserve(n);
+    }
+
+    /**
+     * Add a process in a new slot, its pid is the slot
+     */
+    Process *add(const ProcessSpec &spec) {
+        int slot = (int) slots++;
+        if (slot % BLOCK == 0) {
+            blocks.emplace_back();
+            blocks.back().reserve(BLOCK);
         }
-        runQ[j - 1] = proc;
+        blocks.back().emplace_back(slot, slot, spec);
+        arrival_time.push_back(spec.arrival_time);
+        total_cpu_time.push_back(spec.total_cpu_time);
+        finishing_time.push_back(spec.arrival_time);
+        io_time.push_back(0);
+        cpu_wait_time.push_back(0);
+        response_time.push_back(-1);
+        return &blocks.back().back();
     }
 
-    Process *get_next_process() override {
-        if (runQ.empty()) {
-            return nullptr;
+    /**
+     * Add a process in a released slot if there is one
+     * @param - pid - pid of the process
+     * @param - spec - process parameters
+     */
+    Process *admit(int pid, const ProcessSpec &spec) {
+        if (free_slots.empty()) {
+            Process *p = add(spec);
+            *p = Process(pid, p->get_slot(), spec);
+            return p;
         }
-        Process *p = runQ.back();
-        runQ.pop_back();
+        int slot = free_slots.back();
+        free_slots.pop_back();
+        Process *p = get(slot);
+        *p = Process(pid, slot, spec);
+        arrival_time[slot] = spec.arrival_time;
+        total_cpu_time[slot] = spec.total_cpu_time;
+        finishing_time[slot] = spec.arrival_time;
+        io_time[slot] = 0;
+        cpu_wait_time[slot] = 0;
+        response_time[slot] = -1;
         return p;
     }
 
-    bool test_preempt(Process *activated_proc, Process *curr_proc, DES_Layer *dispatcher, int curr_time) override {
-        return false;
+    /**
+     * Put every process back into the state add gave it, keeping the storage
+     * @param - specs - the specs the processes were added from, in slot order
+     */
+    void reinitialize(const ProcessSpec *specs) {
+        for (size_t slot = 0; slot < slots; slot++) {
+            const ProcessSpec &spec = specs[slot];
+            *get((int) slot) = Process((int) slot, (int) slot, spec);
+            arrival_time[slot] = spec.arrival_time;
+            total_cpu_time[slot] = spec.total_cpu_time;
+            finishing_time[slot] = spec.arrival_time;
+            io_time[slot] = 0;
+            cpu_wait_time[slot] = 0;
+            response_time[slot] = -1;
+        }
+        free_slots.clear();
     }
 
-    string to_string() override {
-        return "SRTF";
+    /**
+     * Give the slot of a finished process back for reuse by admit
+     */
+    void release(Process *p) {
+        free_slots.push_back(p->get_slot());
+    }
+
+    Process *get(int slot) {
+        return &blocks[slot / BLOCK][slot % BLOCK];
+    }
+
+    [[nodiscard]] size_t size() const {
+        return slots;
     }
 };
 
-class RRScheduler : public Scheduler {
+static_assert(is_trivially_copyable<Process>::value, "Process records are written to checkpoints as raw bytes");
+
+/**
+ * Writes the fields of a checkpoint as raw little-endian values. Processes
+ * are written as their slot in the ProcessTable, -1 for none.
+ */
+class SnapshotWriter {
 private:
-    deque<Process *> runQ;
+    FILE *out;
+    bool ok = true;
 
 public:
-    explicit RRScheduler(int num) : Scheduler(num) {}
+    explicit SnapshotWriter(FILE *f) {
+        out = f;
+    }
 
-    void add_process(Process *p) override {
-        p->dynamic_priority = p->static_priority - 1;
-        runQ.push_front(p);
+    template<typename T>
+    void put(const T &value) {
+        static_assert(is_trivially_copyable<T>::value, "only plain values go into a checkpoint");
+        ok = ok && fwrite(&value, sizeof(T), 1, out) == 1;
     }
 
-    Process *get_next_process() override {
-        if (runQ.empty()) {
-            return nullptr;
-        }
-        Process *p = runQ.back();
-        runQ.pop_back();
-        return p;
+    void put_process(const Process *p) {
+        put<int32_t>(p ? p->get_slot() : -1);
     }
 
-    bool test_preempt(Process *activated_proc, Process *curr_proc, DES_Layer *dispatcher, int curr_time) override {
-        return false;
+    void put_string(const string &s) {
+        put<uint32_t>((uint32_t) s.size());
+        ok = ok && fwrite(s.data(), 1, s.size(), out) == s.size();
     }
 
-    string to_string() override {
-        return "RR " + std::to_string(quantum);
+    void put_ring(Ring<Process *> &ring) {
+        put<uint64_t>(ring.size());
+        for (size_t i = 0; i < ring.size(); i++)
+            put_process(ring[i]);
+    }
+
+    void put_table(const ProcessTable &table) {
+        put<uint64_t>(table.slots);
+        for (size_t slot = 0; slot < table.slots; slot++) {
+            put(table.blocks[slot / ProcessTable::BLOCK][slot % ProcessTable::BLOCK]);
+            put(table.arrival_time[slot]);
+            put(table.total_cpu_time[slot]);
+            put(table.finishing_time[slot]);
+            put(table.io_time[slot]);
+            put(table.cpu_wait_time[slot]);
+            put(table.response_time[slot]);
+        }
+        put<uint64_t>(table.free_slots.size());
+        for (int slot: table.free_slots)
+            put(slot);
+    }
+
+    [[nodiscard]] bool good() const {
+        return ok;
     }
 };
 
-class PriorityScheduler : public Scheduler {
+/**
+ * Reads the fields written by SnapshotWriter back from a mapped checkpoint
+ * file, throws on a short or malformed file
+ */
+class SnapshotReader {
 private:
-    vector<deque<Process *>> *activeRunQ = new vector<deque<Process *>>;
-    vector<deque<Process *>> *expiredRunQ = new vector<deque<Process *>>;
+    MappedFile file;
+    const char *pos = nullptr;
+    const char *end = nullptr;
+    const char *filename = nullptr;
+    ProcessTable *table = nullptr;
 
-    static bool is_empty(vector<deque<Process *>> *priorityQ) {
-        for (const deque<Process *> &q: *priorityQ)
-            if (!q.empty())
-                return false;
+public:
+    /**
+     * Reject the checkpoint, also for fields that only the caller can check
+     */
+    [[noreturn]] void fail() {
+        throw_error("Not a valid checkpoint <%s>", filename);
+    }
 
+    /**
+     * @param - name - checkpoint file
+     * @param - processes - table that slots are looked up in
+     *
+     * @returns - false if the file cannot be mapped
+     */
+    bool open(const char *name, ProcessTable *processes) {
+        filename = name;
+        table = processes;
+        if (!file.open(name)) {
+            return false;
+        }
+        pos = file.begin();
+        end = file.end();
         return true;
     }
 
-public:
-    PriorityScheduler(int num, int maxprio) : Scheduler(num, maxprio) {
-        if (max_priority <= 0)
-            max_priority = 4;
-
-        activeRunQ->resize(max_priority);
-        expiredRunQ->resize(max_priority);
+    template<typename T>
+    void get(T &value) {
+        if ((size_t) (end - pos) < sizeof(T))
+            fail();
+        memcpy((void *) &value, pos, sizeof(T));
+        pos += sizeof(T);
     }
 
-    void add_process(Process *p) override {
-
-        int priority = p->dynamic_priority;
+    template<typename T>
+    T get() {
+        T value;
+        get(value);
+        return value;
+    }
 
-        if (priority < 0) {
-            // add to expired queue
-            priority = p->static_priority - 1;
-            p->dynamic_priority = priority;
-            deque<Process *> *expired_q = &((*expiredRunQ)[priority]);
-            expired_q->push_front(p);
+    Process *get_process() {
+        int slot = get<int32_t>();
+        if (slot < -1 || slot >= (int) table->size())
+            fail();
+        return slot < 0 ? nullptr : table->get(slot);
+    }
 
-            return;
+    void get_ring(Ring<Process *> &ring) {
+        auto n = get<uint64_t>();
+        while (n--) {
+            Process *p = get_process();
+            if (p == nullptr)
+                fail();
+            ring.push_back(p);
         }
-
-        // add to active queue
-        deque<Process *> *active_q = &(*activeRunQ)[priority];
-        active_q->push_front(p);
     }
 
-    Process *get_next_process() override {
-        if (is_empty(activeRunQ) && is_empty(expiredRunQ)) {
-            return nullptr;
+    /**
+     * Replace the contents of the table, which may hold the processes created up front
+     */
+    void get_table() {
+        auto n = get<uint64_t>();
+        while (table->size() < n)
+            table->add(ProcessSpec{0, 0, 0, 0});
+        if (table->size() != n)
+            fail();
+        for (size_t slot = 0; slot < n; slot++) {
+            get(*table->get((int) slot));
+            table->arrival_time[slot] = get<int>();
+            table->total_cpu_time[slot] = get<int>();
+            table->finishing_time[slot] = get<int>();
+            table->io_time[slot] = get<int>();
+            table->cpu_wait_time[slot] = get<int>();
+            table->response_time[slot] = get<int>();
         }
+        table->free_slots.resize(get<uint64_t>());
+        for (int &slot: table->free_slots)
+            slot = get<int>();
+    }
 
-        if (is_empty(activeRunQ)) {
-            activeRunQ->swap(*expiredRunQ);
-        }
+    /**
+     * A string written as its length followed by its bytes
+     */
+    string get_string() {
+        auto n = get<uint32_t>();
+        if ((size_t) (end - pos) < n)
+            fail();
+        string s(pos, n);
+        pos += n;
+        return s;
+    }
 
-        deque<Process *> *highest_priority_q = nullptr;
-        for (int i = max_priority - 1; i >= 0; i--) {
-            if (!(*activeRunQ)[i].empty()) {
-                highest_priority_q = &((*activeRunQ)[i]);
-                break;
-            }
+    [[nodiscard]] bool at_end() const {
+        return pos == end;
+    }
+};
+
+/**
+ * A state transition due for a process, a 16-byte value the event queues
+ * store inline. The transition sits in the low bits below the insertion
+ * order, so comparing order compares seq.
+ */
+struct Event {
+    static const int TRANSITION_BITS = 3;
+
+    int slot;       // ProcessTable slot of the process the event works on
+    int timestamp;
+    uint64_t order; // seq << TRANSITION_BITS | transition, seq breaks ties between equal timestamps
+
+    Event() = default;
+
+    Event(int process_slot, int time, Transitions transition, unsigned long long seq) {
+        slot = process_slot;
+        timestamp = time;
+        order = seq << TRANSITION_BITS | transition;
+    }
+
+    [[nodiscard]] Transitions transition() const {
+        return (Transitions) (order & ((1 << TRANSITION_BITS) - 1));
+    }
+
+    [[nodiscard]] unsigned long long seq() const {
+        return order >> TRANSITION_BITS;
+    }
+};
+
+static_assert(sizeof(Event) == 16, "events are stored by value in the queues");
+static_assert(is_trivially_copyable<Event>::value, "queues move events with plain copies");
+
+/**
+ * Ordering used by every event queue backend: earlier timestamp first and,
+ * among equal timestamps, the event that was put first (FIFO)
+ */
+inline bool event_before(const Event &a, const Event &b) {
+    if (a.timestamp != b.timestamp)
+        return a.timestamp < b.timestamp;
+    return a.order < b.order;
+}
+
+/**
+ * Priority queue of events, which it holds by value. top returns nullptr
+ * when the queue is empty, and the pointer is only valid until the next
+ * push or pop; pop must not be called on an empty queue.
+ */
+class EventQueue {
+public:
+    virtual void push(const Event &e) = 0;
+
+    virtual Event pop() = 0;
+
+    virtual const Event *top() = 0;
+
+    virtual size_t size() const = 0;
+
+    /** bytes of storage held, for -a **/
+    virtual size_t memory_bytes() const = 0;
+
+    virtual string to_string() = 0;
+
+    [[nodiscard]] bool empty() const {
+        return size() == 0;
+    }
+
+    virtual ~EventQueue() = default;
+};
+
+/**
+ * Original implementation: sorted ring with linear insertion, O(n) per put
+ */
+class SortedListEventQueue : public EventQueue {
+private:
+    Ring<Event> eventQ;
+
+public:
+    void push(const Event &e) override {
+        eventQ.push_front(e);
+        if (eventQ.size() == 1) {
+            return;
         }
 
-        if (highest_priority_q) {
-            Process *p = highest_priority_q->back();
-            highest_priority_q->pop_back();
-            return p;
+        Event evt = eventQ[0];
+        size_t j = 1;
+        while (j < eventQ.size() && evt.timestamp < eventQ[j].timestamp) {
+            eventQ[j - 1] = eventQ[j];
+            j = j + 1;
         }
+        eventQ[j - 1] = evt;
+    }
 
-        return nullptr;
+    Event pop() override {
+        Event e = eventQ.back();
+        eventQ.pop_back();
+        return e;
     }
 
-    bool test_preempt(Process *activated_proc, Process *curr_proc, DES_Layer *dispatcher, int curr_time) override {
-        return false;
+    const Event *top() override {
+        return eventQ.empty() ? nullptr : &eventQ.back();
+    }
+
+    [[nodiscard]] size_t size() const override {
+        return eventQ.size();
+    }
+
+    [[nodiscard]] size_t memory_bytes() const override {
+        return eventQ.capacity() * sizeof(Event);
     }
 
     string to_string() override {
-        return "PRIO " + std::to_string(quantum);
+        return "LIST";
+    }
+};
+
+/**
+ * Implicit binary min-heap over (timestamp, seq), O(log n) per put/get
+ */
+class BinaryHeapEventQueue : public EventQueue {
+private:
+    vector<Event> heap;
+
+    static bool later(const Event &a, const Event &b) {
+        return event_before(b, a);
+    }
+
+public:
+    void push(const Event &e) override {
+        heap.push_back(e);
+        push_heap(heap.begin(), heap.end(), later);
+    }
+
+    Event pop() override {
+        pop_heap(heap.begin(), heap.end(), later);
+        Event e = heap.back();
+        heap.pop_back();
+        return e;
+    }
+
+    const Event *top() override {
+        return heap.empty() ? nullptr : &heap.front();
+    }
+
+    [[nodiscard]] size_t size() const override {
+        return heap.size();
+    }
+
+    [[nodiscard]] size_t memory_bytes() const override {
+        return heap.capacity() * sizeof(Event);
     }
 
-    ~PriorityScheduler() override {
-        delete activeRunQ;
-        delete expiredRunQ;
+    string to_string() override {
+        return "BHEAP";
     }
 };
 
-class PreemptivePriorityScheduler : public Scheduler {
+/**
+ * Pairing heap, O(1) put and amortized O(log n) get.
+ * Nodes live in a pool indexed by int and are recycled through a free list.
+ */
+class PairingHeapEventQueue : public EventQueue {
 private:
-    vector<deque<Process *>> *activeRunQ = new vector<deque<Process *>>;
-    vector<deque<Process *>> *expiredRunQ = new vector<deque<Process *>>;
+    struct Node {
+        Event event;
+        int child;
+        int sibling;
+    };
+
+    vector<Node> nodes;
+    vector<int> free_nodes;
+    vector<int> pairs; // scratch space for the two-pass merge
+    int root = -1;
+    size_t count = 0;
+
+    int new_node(const Event &e) {
+        int n;
+        if (free_nodes.empty()) {
+            n = (int) nodes.size();
+            nodes.push_back({e, -1, -1});
+        } else {
+            n = free_nodes.back();
+            free_nodes.pop_back();
+            nodes[n] = {e, -1, -1};
+        }
+        return n;
+    }
 
-    static bool is_empty(vector<deque<Process *>> *priorityQ) {
-        for (const deque<Process *> &q: *priorityQ)
-            if (!q.empty())
-                return false;
+    int meld(int a, int b) {
+        if (a < 0) return b;
+        if (b < 0) return a;
+        if (event_before(nodes[b].event, nodes[a].event))
+            swap(a, b);
+        nodes[b].sibling = nodes[a].child;
+        nodes[a].child = b;
+        return a;
+    }
 
-        return true;
+    int merge_pairs(int first) {
+        pairs.clear();
+        while (first >= 0) {
+            int a = first;
+            int b = nodes[a].sibling;
+            first = b >= 0 ? nodes[b].sibling : -1;
+            nodes[a].sibling = -1;
+            if (b >= 0)
+                nodes[b].sibling = -1;
+            pairs.push_back(meld(a, b));
+        }
+        int result = -1;
+        for (auto itr = pairs.rbegin(); itr != pairs.rend(); ++itr)
+            result = meld(*itr, result);
+        return result;
     }
 
 public:
-    PreemptivePriorityScheduler(int num, int maxprio) : Scheduler(num, maxprio) {
-        if (max_priority <= 0)
-            max_priority = 4;
+    void push(const Event &e) override {
+        root = meld(root, new_node(e));
+        count++;
+    }
 
-        activeRunQ->resize(max_priority);
-        expiredRunQ->resize(max_priority);
+    Event pop() override {
+        int old_root = root;
+        Event e = nodes[old_root].event;
+        root = merge_pairs(nodes[old_root].child);
+        free_nodes.push_back(old_root);
+        count--;
+        return e;
     }
 
-    void add_process(Process *p) override {
+    const Event *top() override {
+        return root < 0 ? nullptr : &nodes[root].event;
+    }
 
-        int priority = p->dynamic_priority;
+    [[nodiscard]] size_t size() const override {
+        return count;
+    }
 
-        if (priority < 0) {
-            // add to expired queue
-            priority = p->static_priority - 1;
-            p->dynamic_priority = priority;
-            deque<Process *> *expired_q = &((*expiredRunQ)[priority]);
-            expired_q->push_front(p);
+    [[nodiscard]] size_t memory_bytes() const override {
+        return nodes.capacity() * sizeof(Node) + (free_nodes.capacity() + pairs.capacity()) * sizeof(int);
+    }
 
-            return;
+    string to_string() override {
+        return "PHEAP";
+    }
+};
+
+/**
+ * Calendar queue (R. Brown, 1988): events hashed into "day" buckets of a
+ * fixed width, O(1) expected put/get when the bucket width tracks the mean
+ * gap between events. Buckets are kept sorted descending so the next event
+ * of a bucket is at its back.
+ */
+class CalendarEventQueue : public EventQueue {
+private:
+    vector<vector<Event>> buckets; // only the first nbuckets are in use, the rest keep their capacity
+    size_t nbuckets = 2;
+    long long width = 1;         // time span covered by one bucket
+    int last_bucket = 0;         // bucket of the most recently returned event
+    long long bucket_top = 1;    // upper time bound of last_bucket in the current "year"
+    size_t count = 0;
+    vector<Event> scratch;       // reused by resize to avoid reallocating
+
+    [[nodiscard]] int bucket_of(long long time) const {
+        return (int) ((time / width) % (long long) nbuckets);
+    }
+
+    void set_position(long long time) {
+        last_bucket = bucket_of(time);
+        bucket_top = (time / width + 1) * width;
+    }
+
+    static void insert_sorted(vector<Event> &bucket, const Event &e) {
+        bucket.push_back(e);
+        int j = (int) bucket.size() - 1;
+        while (j > 0 && event_before(bucket[j - 1], e)) {
+            bucket[j] = bucket[j - 1];
+            j--;
+        }
+        bucket[j] = e;
+    }
+
+    /** locate the bucket holding the next event and move the calendar position onto it **/
+    int find_next() {
+        int n = (int) nbuckets;
+        int i = last_bucket;
+        long long top = bucket_top;
+        for (int k = 0; k < n; k++) {
+            vector<Event> &b = buckets[i];
+            if (!b.empty() && b.back().timestamp < top) {
+                last_bucket = i;
+                bucket_top = top;
+                return i;
+            }
+            i = i + 1 == n ? 0 : i + 1;
+            top += width;
         }
 
-        // add to active queue
-        deque<Process *> *active_q = &(*activeRunQ)[priority];
-        active_q->push_front(p);
+        /** nothing within one year, fall back to a direct search **/
+        int best = -1;
+        for (i = 0; i < n; i++) {
+            if (!buckets[i].empty() && (best < 0 || event_before(buckets[i].back(), buckets[best].back())))
+                best = i;
+        }
+        set_position(buckets[best].back().timestamp);
+        return best;
     }
 
-    Process *get_next_process() override {
-        if (is_empty(activeRunQ) && is_empty(expiredRunQ)) {
+    void resize(size_t n) {
+        vector<Event> &events = scratch;
+        events.clear();
+        for (size_t i = 0; i < nbuckets; i++) {
+            events.insert(events.end(), buckets[i].begin(), buckets[i].end());
+            buckets[i].clear();
+        }
+        sort(events.begin(), events.end(), event_before);
+
+        /** bucket width is three times the mean separation of the earliest events **/
+        size_t samples = min(events.size(), (size_t) 25);
+        if (samples > 1) {
+            long long span = events[samples - 1].timestamp - events[0].timestamp;
+            width = max(1LL, 3 * span / (long long) (samples - 1));
+        }
+
+        nbuckets = n;
+        if (buckets.size() < nbuckets)
+            buckets.resize(nbuckets);
+        for (const Event &e: events)
+            buckets[bucket_of(e.timestamp)].push_back(e);
+        for (size_t i = 0; i < nbuckets; i++)
+            reverse(buckets[i].begin(), buckets[i].end());
+        set_position(events.empty() ? 0 : events[0].timestamp);
+    }
+
+public:
+    CalendarEventQueue() {
+        buckets.resize(nbuckets);
+    }
+
+    void push(const Event &e) override {
+        insert_sorted(buckets[bucket_of(e.timestamp)], e);
+        /** every queued event must lie at or after the start of the current bucket **/
+        if (e.timestamp < bucket_top - width) {
+            set_position(e.timestamp);
+        }
+        count++;
+        if (count > 2 * nbuckets)
+            resize(2 * nbuckets);
+    }
+
+    Event pop() override {
+        vector<Event> &b = buckets[find_next()];
+        Event e = b.back();
+        b.pop_back();
+        count--;
+        if (nbuckets > 2 && count < nbuckets / 2)
+            resize(nbuckets / 2);
+        return e;
+    }
+
+    const Event *top() override {
+        if (count == 0) {
             return nullptr;
         }
+        return &buckets[find_next()].back();
+    }
+
+    [[nodiscard]] size_t size() const override {
+        return count;
+    }
+
+    [[nodiscard]] size_t memory_bytes() const override {
+        size_t bytes = (buckets.capacity() + 1) * sizeof(vector<Event>) + scratch.capacity() * sizeof(Event);
+        for (const vector<Event> &b: buckets)
+            bytes += b.capacity() * sizeof(Event);
+        return bytes;
+    }
+
+    string to_string() override {
+        return "CALQ";
+    }
+};
+
+/**
+ * Cheap timestamp for the -t counters: the TSC on x86, steady_clock ticks elsewhere
+ */
+inline unsigned long long cycle_count() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+/**
+ * Event layer on top of an EventQueue. A process has at most one
+ * outstanding event: the events of a transition create the next one only
+ * after it was taken, and a preemption cancels the event a process has
+ * before adding its own. pending holds that event per process slot, so
+ * cancelling is overwriting the slot entry, and an event in the queue that
+ * no longer matches its slot entry is a tombstone dropped when it reaches
+ * the head.
+ */
+class DES_Layer {
+private:
+    EventQueue *eventQ;
+    unsigned long long next_seq = 0;
+    vector<Event> pending;   // per process slot, its outstanding event, timestamp -1 for none
+    int batch_time = -1;     // time of the last get_events_at
+    bool batch_reopened = false; // an event was put at batch_time after that batch was taken
+
+    /** -t counters, only updated when instrumented **/
+    bool instrumented = false;
+    unsigned long long put_ticks = 0;      // cycle_count spent in put_event
+    unsigned long long gets = 0;           // get_event calls that returned an event
+    unsigned long long depth_sum = 0;      // queue depth seen by those calls
+    size_t max_depth = 0;
+    unsigned long long cancelled = 0;      // events cancelled by remove_events
+
+    [[nodiscard]] bool is_pending(const Event &e) const {
+        const Event &p = pending[e.slot];
+        return p.timestamp >= 0 && p.order == e.order;
+    }
 
-        if (is_empty(activeRunQ)) {
-            activeRunQ->swap(*expiredRunQ);
+    void set_pending(const Event &e) {
+        if (e.slot >= (int) pending.size()) {
+            pending.resize(e.slot + 1, Event(0, -1, TRANS_TO_READY, 0));
         }
+        pending[e.slot] = e;
+    }
 
-        deque<Process *> *highest_priority_q = nullptr;
-        for (int i = max_priority - 1; i >= 0; i--) {
-            if (!(*activeRunQ)[i].empty()) {
-                highest_priority_q = &((*activeRunQ)[i]);
-                break;
-            }
+    void clear_pending() {
+        fill(pending.begin(), pending.end(), Event(0, -1, TRANS_TO_READY, 0));
+    }
+
+    /** drop cancelled events sitting at the head of the queue **/
+    void skip_cancelled() {
+        const Event *e;
+        while ((e = eventQ->top()) && !is_pending(*e)) {
+            eventQ->pop();
         }
+    }
 
-        if (highest_priority_q) {
-            Process *p = highest_priority_q->back();
-            highest_priority_q->pop_back();
-            return p;
+public:
+    explicit DES_Layer(EventQueue *q) {
+        eventQ = q;
+    }
+
+    /**
+     * Add the created processes to the Event Queue
+     */
+    void initialize(ProcessTable &processes) {
+        pending.resize(processes.size(), Event(0, -1, TRANS_TO_READY, 0));
+        for (int pid = 0; pid < (int) processes.size(); pid++) {
+            put_event(processes.get(pid), processes.arrival_time[pid], TRANS_TO_READY);
         }
+    }
 
-        return nullptr;
+    [[nodiscard]] size_t memory_bytes() const {
+        return eventQ->memory_bytes() + pending.capacity() * sizeof(Event);
     }
 
-    bool test_preempt(Process *activated_proc, Process *curr_proc, DES_Layer *dispatcher, int curr_time) override {
-        if (curr_proc == nullptr) {
-            return false;
+    [[nodiscard]] unsigned long long event_count() const {
+        return next_seq;
+    }
+
+    /**
+     * Take the next event
+     * @returns - false if no event is left
+     */
+    bool get_event(Event &e) {
+        skip_cancelled();
+        if (instrumented) {
+            size_t depth = eventQ->size();
+            depth_sum += depth;
+            gets += depth > 0;
         }
-        if (activated_proc->get_pid() == curr_proc->get_pid()) {
+        if (eventQ->empty()) {
             return false;
         }
-        bool is_higher_priority = activated_proc->dynamic_priority > curr_proc->dynamic_priority;
-        bool has_no_pending_events = dispatcher != nullptr && !dispatcher->has_pending_events(curr_proc, curr_time);
-        return is_higher_priority && has_no_pending_events;
+        e = eventQ->pop();
+        pending[e.slot].timestamp = -1;
+        return true;
     }
 
-    string to_string() override {
-        return "PREPRIO " + std::to_string(quantum);
+    /**
+     * Append every event due at time t, in (timestamp, seq) order. The events
+     * stay pending for their processes until release_event, so
+     * has_pending_events still sees the rest of a batch while it is processed.
+     * @param - t - time of the batch, normally get_next_event_time()
+     * @param - batch - receives the events
+     */
+    void get_events_at(int t, vector<Event> &batch) {
+        batch_time = t;
+        batch_reopened = false;
+        const Event *e;
+        while (skip_cancelled(), (e = eventQ->top()) && e->timestamp == t) {
+            if (instrumented) {
+                depth_sum += eventQ->size();
+                gets++;
+            }
+            batch.push_back(eventQ->pop());
+        }
+    }
+
+    /**
+     * True if an event was put at the time of the last batch after the batch
+     * was taken, so more events are due at that time. Events put at the
+     * current time are never cancelled, so this needs no look at the queue.
+     */
+    [[nodiscard]] bool has_more_at_batch_time() const {
+        return batch_reopened;
+    }
+
+    /**
+     * Mark an event taken by get_events_at as processed. Streamed arrivals
+     * never were pending, their slot was free when they were admitted.
+     */
+    void release_event(const Event &e) {
+        if (e.slot < (int) pending.size() && is_pending(e))
+            pending[e.slot].timestamp = -1;
+    }
+
+    int get_next_event_time() {
+        skip_cancelled();
+        const Event *e = eventQ->top();
+        if (e == nullptr) {
+            return -1;
+        }
+        return e->timestamp;
+    }
+
+    /**
+     * Create an event and put it into the queue, it replaces the outstanding
+     * event of the process if there still is one
+     */
+    void put_event(Process *p, int timestamp, Transitions transition) {
+        unsigned long long start = instrumented ? cycle_count() : 0;
+        Event e(p->get_slot(), timestamp, transition, next_seq++);
+        set_pending(e);
+        eventQ->push(e);
+        batch_reopened |= timestamp == batch_time;
+        if (instrumented) {
+            put_ticks += cycle_count() - start;
+            max_depth = max(max_depth, eventQ->size());
+        }
+    }
+
+    /**
+     * Write the outstanding events, cancelled events are dropped, they
+     * would be skipped anyway
+     */
+    void save(SnapshotWriter &out) {
+        out.put(next_seq);
+        uint64_t n = 0;
+        for (const Event &e: pending)
+            n += e.timestamp >= 0;
+        out.put(n);
+        for (const Event &e: pending) {
+            if (e.timestamp < 0)
+                continue;
+            out.put<int32_t>(e.slot);
+            out.put(e.timestamp);
+            out.put<int32_t>(e.transition());
+            out.put(e.seq());
+        }
+    }
+
+    /**
+     * Drop every queued event and start the counters over, the queue
+     * storage is kept for the next run
+     */
+    void clear() {
+        while (!eventQ->empty())
+            eventQ->pop();
+        clear_pending();
+        next_seq = 0;
+        batch_time = -1;
+        batch_reopened = false;
+        put_ticks = gets = depth_sum = cancelled = 0;
+        max_depth = 0;
+    }
+
+    /**
+     * Replace the queue contents with the events of a checkpoint, keeping their seq
+     */
+    void restore(SnapshotReader &in) {
+        while (!eventQ->empty())
+            eventQ->pop();
+        clear_pending();
+
+        next_seq = in.get<unsigned long long>();
+        auto n = in.get<uint64_t>();
+        while (n--) {
+            Process *p = in.get_process();
+            int timestamp = in.get<int>();
+            auto transition = (Transitions) in.get<int32_t>();
+            if (p == nullptr || transition < TRANS_TO_BLOCK || transition > TRANS_TO_RUN)
+                in.fail();
+            Event e(p->get_slot(), timestamp, transition, in.get<unsigned long long>());
+            set_pending(e);
+            eventQ->push(e);
+        }
+    }
+
+    /**
+     * Turn the -t counters on or off
+     */
+    void instrument(bool on) {
+        instrumented = on;
+    }
+
+    /**
+     * Print the -t counters of the event queue
+     * @param - ns_per_tick - length of one cycle_count tick
+     */
+    void print_stats(double ns_per_tick) const {
+        printf("STATS: puts=%llu put_cost=%.1lf ns (%.1lf ticks) cancelled=%llu\n",
+               next_seq, next_seq ? put_ticks * ns_per_tick / next_seq : 0.0,
+               next_seq ? put_ticks / (double) next_seq : 0.0, cancelled);
+        printf("STATS: queue_depth max=%zu avg=%.2lf\n", max_depth, gets ? depth_sum / (double) gets : 0.0);
+    }
+
+    /**
+     * True if the process has an outstanding event at time
+     */
+    bool has_pending_events(Process *process, int time) {
+        if (process->get_slot() >= (int) pending.size())
+            return false;
+        return pending[process->get_slot()].timestamp == time;
+    }
+
+    /**
+     * Cancel the outstanding event of a process unless it is due now; it
+     * stays in the queue as a tombstone and is discarded when it reaches the head
+     */
+    void remove_events(Process *process, int now) {
+        if (process->get_slot() >= (int) pending.size())
+            return;
+        Event &e = pending[process->get_slot()];
+        if (e.timestamp >= 0 && e.timestamp != now) {
+            e.timestamp = -1;
+            cancelled++;
+        }
     }
 
-    ~PreemptivePriorityScheduler() override {
-        delete activeRunQ;
-        delete expiredRunQ;
+    ~DES_Layer() {
+        delete eventQ;
     }
 };
 
-/**
- * Global variables
- */
-map<Proc_State, string> STATE_STRING = {
-        {Proc_State::BLOCKED, "BLOCK"},
-        {Proc_State::CREATED, "CREATED"},
-        {Proc_State::PREEMPT, "PREEMPT"},
-        {Proc_State::READY,   "READY"},
-        {Proc_State::RUNNING, "RUNNG"}};      // convert enums to strings
-int RAND_COUNT = 0;                         // total number of random numbers in file
-vector<int> RANDVALS;                       // initialize a list of random numbers
-int OFS = 0;                                // line offset for the random file
-vector<Process *> PROCESSES;                // initialize a list of processes
-int Process::process_count = 0;             // set process count static data to 0
-int CURRENT_TIME = 0;                       // current CPU time
-int BLOCKED_PROCESS_COUNT = 0;              // total number of blocked process at a particular time
-int TIME_IO_BUSY = 0;                       // time at least one process is performing IO
-bool CALL_SCHEDULER = false;                // flag to call the next process in the scheduler
-Scheduler *SCHEDULER = nullptr;             // Scheduler instance being used in simulation
-Process *CURRENT_RUNNING_PROCESS = nullptr; // pointer to the current running process
-DES_Layer *DISPATCHER = nullptr;            // DES Layer being used in the simulation
-bool VERBOSE = false;                       // flag to display extra information for every event
+class Scheduler {
+protected:
+    int quantum;
+    int max_priority;
 
-/** Not implemented these features **/
-bool SHOW_SCHED_DETAILS = false;
-bool SHOW_EVENT_TRACE = false;
-bool SHOW_PREEMPTION_TRACE = false;
-bool SHOW_SINGLE_STEP = false;
+public:
+    explicit Scheduler(int q = 10000, int maxprio = 4) {
+        quantum = q;
+        max_priority = maxprio;
+    }
+
+    virtual void add_process(Process *p) = 0;
+
+    virtual Process *get_next_process() = 0;
+
+    /**
+     * Add processes in order, as a series of add_process calls would
+     */
+    virtual void add_processes(Process *const *procs, size_t n) {
+        for (size_t i = 0; i < n; i++)
+            add_process(procs[i]);
+    }
+
+    virtual string to_string() = 0;
+
+    virtual bool test_preempt(Process *activated_proc, Process *curr_proc, DES_Layer *dispatcher, int curr_time) = 0;
+
+    /** false if test_preempt never returns true, the event loop then skips the call **/
+    [[nodiscard]] virtual bool may_preempt() const {
+        return true;
+    }
+
+    /** empty the run queue and forget what was learned about processes, keeping the allocated capacity **/
+    virtual void clear() = 0;
+
+    /** write and read back the run queue contents for a checkpoint **/
+    virtual void save(SnapshotWriter &out) = 0;
+
+    virtual void restore(SnapshotReader &in) = 0;
+
+    [[nodiscard]] int get_maxprio() const {
+        return max_priority;
+    }
+
+    [[nodiscard]] int get_quant() const {
+        return quantum;
+    }
+
+    /**
+     * CPU time a process being dispatched may use before it is preempted
+     */
+    virtual int time_slice(Process *) {
+        return quantum;
+    }
+
+    virtual ~Scheduler() = default;
+};
+
+class FCFSScheduler final : public Scheduler {
+private:
+    Ring<Process *> runQ;
+
+public:
+
+    void add_process(Process *p) override {
+        runQ.push_front(p);
+    }
+
+    Process *get_next_process() override {
+        if (runQ.empty()) {
+            return nullptr;
+        }
+        Process *p = runQ.back();
+        runQ.pop_back();
+        return p;
+    }
+
+    bool test_preempt(Process *, Process *, DES_Layer *, int) override {
+        return false;
+    }
+
+    [[nodiscard]] bool may_preempt() const override {
+        return false;
+    }
+
+    void clear() override {
+        runQ.clear();
+    }
+
+    void save(SnapshotWriter &out) override {
+        out.put_ring(runQ);
+    }
+
+    void restore(SnapshotReader &in) override {
+        in.get_ring(runQ);
+    }
+
+    string to_string() override {
+        return "FCFS";
+    }
+};
+
+class LCFSScheduler final : public Scheduler {
+private:
+    Ring<Process *> runQ;
+
+public:
+
+    void add_process(Process *p) override {
+        runQ.push_front(p);
+    }
+
+    Process *get_next_process() override {
+        if (runQ.empty()) {
+            return nullptr;
+        }
+        Process *p = runQ.front();
+        runQ.pop_front();
+        return p;
+    }
+
+    bool test_preempt(Process *, Process *, DES_Layer *, int) override {
+        return false;
+    }
+
+    [[nodiscard]] bool may_preempt() const override {
+        return false;
+    }
+
+    void clear() override {
+        runQ.clear();
+    }
+
+    void save(SnapshotWriter &out) override {
+        out.put_ring(runQ);
+    }
+
+    void restore(SnapshotReader &in) override {
+        in.get_ring(runQ);
+    }
+
+    string to_string() override {
+        return "LCFS";
+    }
+};
+
+/**
+ * Shortest remaining time first. Ready processes sit in a binary heap keyed by
+ * (remaining_cpu_time, enqueue order), so among equal remaining times the
+ * process enqueued first runs first. The preemptive variant lets a newly
+ * ready process preempt a running one with more CPU time left.
+ */
+template<bool PREEMPTIVE>
+class RemainingTimeScheduler final : public Scheduler {
+private:
+    struct Entry {
+        int remaining_cpu_time;
+        unsigned long long seq;
+        Process *process;
+    };
+
+    vector<Entry> runQ;
+    unsigned long long next_seq = 0;
+
+    static bool runs_later(const Entry &a, const Entry &b) {
+        if (a.remaining_cpu_time != b.remaining_cpu_time)
+            return a.remaining_cpu_time > b.remaining_cpu_time;
+        return a.seq > b.seq;
+    }
+
+public:
+
+    void add_process(Process *p) override {
+        runQ.push_back({p->remaining_cpu_time, next_seq++, p});
+        push_heap(runQ.begin(), runQ.end(), runs_later);
+    }
+
+    /** (remaining_cpu_time, seq) is a total order, so a heap rebuilt in one go pops in the same order **/
+    void add_processes(Process *const *procs, size_t n) override {
+        size_t old_size = runQ.size();
+        for (size_t i = 0; i < n; i++)
+            runQ.push_back({procs[i]->remaining_cpu_time, next_seq++, procs[i]});
+        if (n > old_size) {
+            make_heap(runQ.begin(), runQ.end(), runs_later);
+            return;
+        }
+        for (size_t i = old_size; i < runQ.size(); i++)
+            push_heap(runQ.begin(), runQ.begin() + (long) i + 1, runs_later);
+    }
+
+    Process *get_next_process() override {
+        if (runQ.empty()) {
+            return nullptr;
+        }
+        pop_heap(runQ.begin(), runQ.end(), runs_later);
+        Process *p = runQ.back().process;
+        runQ.pop_back();
+        return p;
+    }
+
+    [[nodiscard]] bool may_preempt() const override {
+        return PREEMPTIVE;
+    }
+
+    bool test_preempt(Process *activated_proc, Process *curr_proc, DES_Layer *dispatcher, int curr_time) override {
+        if (!PREEMPTIVE || curr_proc == nullptr) {
+            return false;
+        }
+        if (activated_proc->get_pid() == curr_proc->get_pid()) {
+            return false;
+        }
+        /** remaining_cpu_time of the running process is only updated when it leaves RUNNING **/
+        int curr_remaining = curr_proc->remaining_cpu_time - (curr_time - curr_proc->state_start_time);
+        bool is_shorter = activated_proc->remaining_cpu_time < curr_remaining;
+        bool has_no_pending_events = dispatcher != nullptr && !dispatcher->has_pending_events(curr_proc, curr_time);
+        return is_shorter && has_no_pending_events;
+    }
+
+    void clear() override {
+        runQ.clear();
+        next_seq = 0;
+    }
+
+    void save(SnapshotWriter &out) override {
+        out.put(next_seq);
+        out.put<uint64_t>(runQ.size());
+        for (const Entry &e: runQ) {
+            out.put(e.remaining_cpu_time);
+            out.put(e.seq);
+            out.put_process(e.process);
+        }
+    }
+
+    void restore(SnapshotReader &in) override {
+        next_seq = in.get<unsigned long long>();
+        runQ.resize(in.get<uint64_t>());
+        for (Entry &e: runQ) {
+            e.remaining_cpu_time = in.get<int>();
+            e.seq = in.get<unsigned long long>();
+            e.process = in.get_process();
+        }
+    }
+
+    string to_string() override {
+        return PREEMPTIVE ? "PRESRTF" : "SRTF";
+    }
+};
+
+typedef RemainingTimeScheduler<false> SRTFScheduler;
+typedef RemainingTimeScheduler<true> PreemptiveSRTFScheduler;
+
+class RRScheduler final : public Scheduler {
+private:
+    Ring<Process *> runQ;
+
+public:
+
+    explicit RRScheduler(int num) : Scheduler(num) {}
+
+    void add_process(Process *p) override {
+        p->dynamic_priority = p->static_priority - 1;
+        runQ.push_front(p);
+    }
+
+    Process *get_next_process() override {
+        if (runQ.empty()) {
+            return nullptr;
+        }
+        Process *p = runQ.back();
+        runQ.pop_back();
+        return p;
+    }
+
+    bool test_preempt(Process *, Process *, DES_Layer *, int) override {
+        return false;
+    }
+
+    [[nodiscard]] bool may_preempt() const override {
+        return false;
+    }
+
+    void clear() override {
+        runQ.clear();
+    }
+
+    void save(SnapshotWriter &out) override {
+        out.put_ring(runQ);
+    }
+
+    void restore(SnapshotReader &in) override {
+        in.get_ring(runQ);
+    }
+
+    string to_string() override {
+        return "RR " + std::to_string(quantum);
+    }
+};
+
+/**
+ * One array of per-priority FIFO queues plus a bitmap of the non-empty levels,
+ * so the highest non-empty level is found with a count-leading-zeros per
+ * 64 levels instead of a scan over every queue
+ */
+class PriorityArray {
+private:
+    vector<Ring<Process *>> levels;
+    vector<unsigned long long> bitmap; // bit i set when levels[i] is not empty
+    size_t count = 0;
+
+public:
+    explicit PriorityArray(int num_levels) {
+        levels.resize(num_levels);
+        bitmap.resize((num_levels + 63) / 64, 0);
+    }
+
+    [[nodiscard]] bool empty() const {
+        return count == 0;
+    }
+
+    void push(int priority, Process *p) {
+        levels[priority].push_front(p);
+        bitmap[priority / 64] |= 1ULL << (priority % 64);
+        count++;
+    }
+
+    /** remove the oldest process of the highest non-empty level, the array must not be empty **/
+    Process *pop_highest() {
+        int w = (int) bitmap.size() - 1;
+        while (bitmap[w] == 0)
+            w--;
+        int priority = w * 64 + 63 - __builtin_clzll(bitmap[w]);
+
+        Ring<Process *> &q = levels[priority];
+        Process *p = q.back();
+        q.pop_back();
+        if (q.empty())
+            bitmap[w] &= ~(1ULL << (priority % 64));
+        count--;
+        return p;
+    }
+
+    void clear() {
+        for (Ring<Process *> &q: levels)
+            q.clear();
+        fill(bitmap.begin(), bitmap.end(), 0);
+        count = 0;
+    }
+
+    void save(SnapshotWriter &out) {
+        for (Ring<Process *> &q: levels)
+            out.put_ring(q);
+    }
+
+    void restore(SnapshotReader &in) {
+        for (size_t priority = 0; priority < levels.size(); priority++) {
+            in.get_ring(levels[priority]);
+            if (!levels[priority].empty())
+                bitmap[priority / 64] |= 1ULL << (priority % 64);
+            count += levels[priority].size();
+        }
+    }
+};
+
+/**
+ * Multi-level priority scheduler with active and expired arrays (Linux O(1)
+ * scheduler style). A process whose dynamic priority drops below zero goes
+ * to the expired array; once the active array drains, the two are swapped.
+ * PREEMPTIVE selects whether a newly ready process may preempt a running one
+ * of lower priority.
+ */
+template<bool PREEMPTIVE>
+class MultiLevelScheduler final : public Scheduler {
+private:
+    PriorityArray arrays[2];
+    int active = 0; // index of the active array, the other one is expired
+
+    static int levels(int maxprio) {
+        return maxprio <= 0 ? 4 : maxprio;
+    }
+
+public:
+
+    MultiLevelScheduler(int num, int maxprio)
+            : Scheduler(num, levels(maxprio)), arrays{PriorityArray(levels(maxprio)), PriorityArray(levels(maxprio))} {
+    }
+
+    void add_process(Process *p) override {
+
+        int priority = p->dynamic_priority;
+
+        if (priority < 0) {
+            // add to expired queue
+            priority = p->static_priority - 1;
+            p->dynamic_priority = priority;
+            arrays[active ^ 1].push(priority, p);
+
+            return;
+        }
+
+        // add to active queue
+        arrays[active].push(priority, p);
+    }
+
+    Process *get_next_process() override {
+        if (arrays[active].empty()) {
+            if (arrays[active ^ 1].empty()) {
+                return nullptr;
+            }
+            active ^= 1;
+        }
+
+        return arrays[active].pop_highest();
+    }
+
+    [[nodiscard]] bool may_preempt() const override {
+        return PREEMPTIVE;
+    }
+
+    bool test_preempt(Process *activated_proc, Process *curr_proc, DES_Layer *dispatcher, int curr_time) override {
+        if (!PREEMPTIVE || curr_proc == nullptr) {
+            return false;
+        }
+        if (activated_proc->get_pid() == curr_proc->get_pid()) {
+            return false;
+        }
+        bool is_higher_priority = activated_proc->dynamic_priority > curr_proc->dynamic_priority;
+        bool has_no_pending_events = dispatcher != nullptr && !dispatcher->has_pending_events(curr_proc, curr_time);
+        return is_higher_priority && has_no_pending_events;
+    }
+
+    void clear() override {
+        arrays[0].clear();
+        arrays[1].clear();
+        active = 0;
+    }
+
+    void save(SnapshotWriter &out) override {
+        out.put(active);
+        arrays[0].save(out);
+        arrays[1].save(out);
+    }
+
+    void restore(SnapshotReader &in) override {
+        active = in.get<int>() & 1;
+        arrays[0].restore(in);
+        arrays[1].restore(in);
+    }
+
+    string to_string() override {
+        return (PREEMPTIVE ? "PREPRIO " : "PRIO ") + std::to_string(quantum);
+    }
+};
+
+typedef MultiLevelScheduler<false> PriorityScheduler;
+typedef MultiLevelScheduler<true> PreemptivePriorityScheduler;
+
+/**
+ * Completely-fair style scheduler. Ready processes sit in a binary heap keyed
+ * by (vruntime, enqueue order); vruntime grows by the CPU time a process used,
+ * scaled down by its weight, so heavier processes get a larger CPU share. The
+ * weight follows static_priority like a nice level (priority p acts as nice
+ * 1 - p). A dispatched process gets its weighted share of the scheduling
+ * period, target latency stretched to min granularity per runnable process,
+ * and a waking process preempts the running one whose vruntime is ahead by
+ * more than the wakeup granularity.
+ *
+ * The scheduler keeps the vruntime of every process it has seen per slot and
+ * charges CPU time from the drop in remaining_cpu_time since the process was
+ * last charged, so the event loop needs no extra hooks.
+ */
+class CFSScheduler final : public Scheduler {
+private:
+    struct Entry {
+        long long vruntime;
+        unsigned long long seq;
+        Process *process;
+    };
+
+    struct Entity {
+        long long vruntime;     // weighted CPU time, in units of 1/1024 for a nice 0 process
+        int pid;                // process the slot was last used for, -1 for none
+        int charged_remaining;  // remaining_cpu_time when the process was last charged
+    };
+
+    static constexpr int NICE_0_WEIGHT = 1024;
+
+    vector<Entry> runQ;
+    vector<Entity> entities;            // indexed by process slot
+    unsigned long long next_seq = 0;
+    long long min_vruntime = 0;         // monotonic floor for new and waking processes
+    long long queued_weight = 0;        // total weight of the processes in runQ
+    int target_latency;
+    int min_granularity;
+
+    static bool runs_later(const Entry &a, const Entry &b) {
+        if (a.vruntime != b.vruntime)
+            return a.vruntime > b.vruntime;
+        return a.seq > b.seq;
+    }
+
+    /** Linux sched_prio_to_weight for nice 0 down to nice -20 **/
+    static int weight(const Process *p) {
+        static const int WEIGHTS[] = {1024, 1277, 1586, 1991, 2501, 3121, 3906, 4904, 6100, 7620, 9548,
+                                      11916, 14949, 18705, 23254, 29154, 36291, 46273, 56483, 71755, 88761};
+        int level = min(max(p->static_priority - 1, 0), 20);
+        return WEIGHTS[level];
+    }
+
+    static long long scaled(long long time, const Process *p) {
+        return time * NICE_0_WEIGHT * NICE_0_WEIGHT / weight(p);
+    }
+
+    Entity &entity(const Process *p) {
+        int slot = p->get_slot();
+        if (slot >= (int) entities.size())
+            entities.resize(slot + 1, Entity{0, -1, 0});
+        Entity &e = entities[slot];
+        if (e.pid != p->get_pid()) {
+            /** a process new to this run queue starts at the floor **/
+            e.pid = p->get_pid();
+            e.vruntime = min_vruntime;
+            e.charged_remaining = p->remaining_cpu_time;
+        }
+        return e;
+    }
+
+    /**
+     * Charge the CPU time used since the last charge and keep a process that
+     * slept from coming back with a large credit
+     */
+    Entity &settle(const Process *p) {
+        Entity &e = entity(p);
+        e.vruntime += scaled(e.charged_remaining - p->remaining_cpu_time, p);
+        e.charged_remaining = p->remaining_cpu_time;
+        e.vruntime = max(e.vruntime, min_vruntime - scaled(target_latency, p) / 2);
+        return e;
+    }
+
+public:
+
+    CFSScheduler(int latency, int granularity) {
+        target_latency = latency;
+        min_granularity = granularity;
+    }
+
+    void add_process(Process *p) override {
+        Entity &e = settle(p);
+        runQ.push_back({e.vruntime, next_seq++, p});
+        push_heap(runQ.begin(), runQ.end(), runs_later);
+        queued_weight += weight(p);
+    }
+
+    void add_processes(Process *const *procs, size_t n) override {
+        size_t old_size = runQ.size();
+        for (size_t i = 0; i < n; i++) {
+            runQ.push_back({settle(procs[i]).vruntime, next_seq++, procs[i]});
+            queued_weight += weight(procs[i]);
+        }
+        if (n > old_size) {
+            make_heap(runQ.begin(), runQ.end(), runs_later);
+            return;
+        }
+        for (size_t i = old_size; i < runQ.size(); i++)
+            push_heap(runQ.begin(), runQ.begin() + (long) i + 1, runs_later);
+    }
+
+    Process *get_next_process() override {
+        if (runQ.empty()) {
+            return nullptr;
+        }
+        pop_heap(runQ.begin(), runQ.end(), runs_later);
+        Entry next = runQ.back();
+        runQ.pop_back();
+        queued_weight -= weight(next.process);
+        min_vruntime = max(min_vruntime, next.vruntime);
+        return next.process;
+    }
+
+    /**
+     * Weighted share of the scheduling period for a process being dispatched
+     */
+    int time_slice(Process *p) override {
+        long long runnable = (long long) runQ.size() + 1;
+        long long period = max((long long) target_latency, runnable * min_granularity);
+        long long slice = period * weight(p) / (queued_weight + weight(p));
+        return (int) max(slice, (long long) min_granularity);
+    }
+
+    bool test_preempt(Process *activated_proc, Process *curr_proc, DES_Layer *dispatcher, int curr_time) override {
+        if (curr_proc == nullptr || activated_proc->get_pid() == curr_proc->get_pid()) {
+            return false;
+        }
+        /** a process with an event now has not started or is leaving the CPU anyway **/
+        if (dispatcher == nullptr || dispatcher->has_pending_events(curr_proc, curr_time)) {
+            return false;
+        }
+        long long activated = settle(activated_proc).vruntime;
+        /** the running process has not been charged for its current stretch yet **/
+        long long curr = entity(curr_proc).vruntime + scaled(curr_time - curr_proc->state_start_time, curr_proc);
+        return curr - activated > scaled(min_granularity, activated_proc);
+    }
+
+    void clear() override {
+        runQ.clear();
+        fill(entities.begin(), entities.end(), Entity{0, -1, 0});
+        next_seq = 0;
+        min_vruntime = 0;
+        queued_weight = 0;
+    }
+
+    void save(SnapshotWriter &out) override {
+        out.put(next_seq);
+        out.put(min_vruntime);
+        out.put(queued_weight);
+        out.put<uint64_t>(runQ.size());
+        for (const Entry &e: runQ) {
+            out.put(e.vruntime);
+            out.put(e.seq);
+            out.put_process(e.process);
+        }
+        out.put<uint64_t>(entities.size());
+        for (const Entity &e: entities)
+            out.put(e);
+    }
+
+    void restore(SnapshotReader &in) override {
+        next_seq = in.get<unsigned long long>();
+        min_vruntime = in.get<long long>();
+        queued_weight = in.get<long long>();
+        runQ.resize(in.get<uint64_t>());
+        for (Entry &e: runQ) {
+            e.vruntime = in.get<long long>();
+            e.seq = in.get<unsigned long long>();
+            e.process = in.get_process();
+        }
+        entities.resize(in.get<uint64_t>());
+        for (Entity &e: entities)
+            in.get(e);
+    }
+
+    string to_string() override {
+        return "CFS " + std::to_string(target_latency) + ":" + std::to_string(min_granularity);
+    }
+};
+
+enum Balance_Policy {
+    GLOBAL_QUEUE,       // every CPU pulls from one shared run queue
+    WORK_STEALING,      // per-CPU run queues, an idle CPU steals from the longest one
+    PERIODIC_REBALANCE  // per-CPU run queues, evened out at a fixed interval
+};
+
+/**
+ * A simulated CPU with its own run queue (shared by all CPUs under GLOBAL_QUEUE)
+ */
+class CPU {
+public:
+    int id;
+    Scheduler *scheduler;       // run queue feeding this CPU
+    Process *running = nullptr; // process currently on this CPU
+    int queued = 0;             // processes waiting in this CPU's run queue
+    int busy_time = 0;          // time spent running processes
+    int dispatches = 0;         // processes dispatched on this CPU
+    int migrations = 0;         // dispatches of a process that last ran on another CPU
+    int steals = 0;             // processes taken from another CPU's run queue
+    unsigned long long queue_histogram[32] = {}; // -t: run queue length at dispatch, bucket k holds [2^(k-1), 2^k)
+    vector<Process *> ready_batch; // processes that became ready during the current batch, not yet in the run queue
+
+    CPU(int num, Scheduler *s) {
+        id = num;
+        scheduler = s;
+    }
+};
+
+enum IO_Discipline {
+    IO_FIFO,     // requests are served in arrival order
+    IO_SHORTEST, // shortest service time first, the stand-in for SSTF as the model has no disk positions
+    IO_DEADLINE  // shortest first, but a request waiting at least the expiry time goes next
+};
+
+/**
+ * A simulated IO device serving up to `concurrency` requests at a time.
+ * Requests that find every channel busy wait in the device queue in the
+ * order of its discipline. Under IO_DEADLINE a waiting request sits both in
+ * the FIFO, for expiry, and in the heap; taking it from the heap marks its
+ * FIFO entry, and heap entries already served through the FIFO are dropped
+ * when they surface, so both orders cost O(log n) and a device in steady
+ * state does not allocate.
+ */
+class IODevice {
+private:
+    struct Request {
+        int service;            // ib drawn when the process blocked
+        int enqueue_time;
+        unsigned long long seq; // consecutive per device, so a FIFO entry sits at seq - front().seq
+        Process *process;
+        bool served;            // IO_DEADLINE: taken from the heap, skipped in the FIFO
+    };
+
+    Ring<Request> fifo;         // IO_FIFO and IO_DEADLINE: waiting requests in arrival order
+    vector<Request> heap;       // IO_SHORTEST and IO_DEADLINE: waiting requests keyed by (service, seq)
+    unsigned long long next_seq = 0;
+
+    static bool served_later(const Request &a, const Request &b) {
+        if (a.service != b.service)
+            return a.service > b.service;
+        return a.seq > b.seq;
+    }
+
+    /** true if the FIFO no longer holds a heap entry as waiting **/
+    bool is_stale(const Request &r) {
+        return fifo.empty() || r.seq < fifo.front().seq || fifo[r.seq - fifo.front().seq].served;
+    }
+
+    void drop_served() {
+        while (!fifo.empty() && fifo.front().served)
+            fifo.pop_front();
+    }
+
+    Request take_next(int now) {
+        if (discipline == IO_FIFO) {
+            Request r = fifo.front();
+            fifo.pop_front();
+            return r;
+        }
+        if (discipline == IO_DEADLINE) {
+            drop_served();
+            if (now - fifo.front().enqueue_time >= expire) {
+                Request r = fifo.front();
+                fifo.pop_front();
+                return r;
+            }
+            while (is_stale(heap.front())) {
+                pop_heap(heap.begin(), heap.end(), served_later);
+                heap.pop_back();
+            }
+        }
+        pop_heap(heap.begin(), heap.end(), served_later);
+        Request r = heap.back();
+        heap.pop_back();
+        if (discipline == IO_DEADLINE) {
+            fifo[r.seq - fifo.front().seq].served = true;
+            drop_served();
+        }
+        return r;
+    }
+
+    void start(int service, int now) {
+        if (in_service++ == 0)
+            busy_start = now;
+        service_time += service;
+    }
+
+public:
+    int id;
+    IO_Discipline discipline;
+    int concurrency;            // requests served at the same time
+    int expire;                 // IO_DEADLINE: wait after which a request is served next
+    int in_service = 0;
+    int queued = 0;             // requests waiting for a free channel
+    int busy_time = 0;          // time with at least one request in service
+    int busy_start = 0;
+    long long service_time = 0; // service summed over the requests, busy channel time
+    unsigned long long requests = 0;
+    unsigned long long delayed = 0; // requests that waited in the queue
+    long long wait_time = 0;    // time requests spent in the queue
+    int max_wait = 0;
+    int max_queue = 0;
+
+    IODevice(int num, IO_Discipline d, int channels, int expiry) {
+        id = num;
+        discipline = d;
+        concurrency = channels;
+        expire = expiry;
+    }
+
+    /**
+     * Hand a request to the device
+     * @param - p - the blocking process
+     * @param - service - time the request occupies a channel
+     * @param - now - current time
+     *
+     * @returns - true if a channel was free and the request is served from now on
+     */
+    bool submit(Process *p, int service, int now) {
+        requests++;
+        if (in_service < concurrency) {
+            start(service, now);
+            return true;
+        }
+        Request r{service, now, next_seq++, p, false};
+        if (discipline != IO_SHORTEST)
+            fifo.push_back(r);
+        if (discipline != IO_FIFO) {
+            heap.push_back(r);
+            push_heap(heap.begin(), heap.end(), served_later);
+        }
+        queued++;
+        max_queue = max(max_queue, queued);
+        return false;
+    }
+
+    /**
+     * Finish a request and start the next waiting one on the freed channel
+     * @param - now - current time
+     * @param - service - receives the service time of the started request
+     *
+     * @returns - the process whose request was started, nullptr if none was waiting
+     */
+    Process *complete(int now, int &service) {
+        if (--in_service == 0)
+            busy_time += now - busy_start;
+        if (queued == 0) {
+            return nullptr;
+        }
+        Request r = take_next(now);
+        queued--;
+        int wait = now - r.enqueue_time;
+        delayed++;
+        wait_time += wait;
+        max_wait = max(max_wait, wait);
+        start(r.service, now);
+        service = r.service;
+        return r.process;
+    }
+
+    /**
+     * Drop the waiting requests and the counters, keeping the queue storage
+     */
+    void clear() {
+        fifo.clear();
+        heap.clear();
+        next_seq = 0;
+        in_service = queued = busy_time = busy_start = 0;
+        service_time = wait_time = 0;
+        requests = delayed = 0;
+        max_wait = max_queue = 0;
+    }
+
+    void save(SnapshotWriter &out) {
+        out.put(in_service);
+        out.put(queued);
+        out.put(busy_time);
+        out.put(busy_start);
+        out.put(service_time);
+        out.put(requests);
+        out.put(delayed);
+        out.put(wait_time);
+        out.put(max_wait);
+        out.put(max_queue);
+        out.put(next_seq);
+        out.put<uint64_t>(fifo.size());
+        for (size_t i = 0; i < fifo.size(); i++) {
+            out.put(fifo[i].service);
+            out.put(fifo[i].enqueue_time);
+            out.put(fifo[i].seq);
+            out.put_process(fifo[i].process);
+            out.put(fifo[i].served);
+        }
+        out.put<uint64_t>(heap.size());
+        for (const Request &r: heap) {
+            out.put(r.service);
+            out.put(r.enqueue_time);
+            out.put(r.seq);
+            out.put_process(r.process);
+        }
+    }
+
+    void restore(SnapshotReader &in) {
+        in.get(in_service);
+        in.get(queued);
+        in.get(busy_time);
+        in.get(busy_start);
+        in.get(service_time);
+        in.get(requests);
+        in.get(delayed);
+        in.get(wait_time);
+        in.get(max_wait);
+        in.get(max_queue);
+        in.get(next_seq);
+        auto n = in.get<uint64_t>();
+        while (n--) {
+            Request r{};
+            in.get(r.service);
+            in.get(r.enqueue_time);
+            in.get(r.seq);
+            r.process = in.get_process();
+            in.get(r.served);
+            fifo.push_back(r);
+        }
+        heap.resize(in.get<uint64_t>());
+        for (Request &r: heap) {
+            in.get(r.service);
+            in.get(r.enqueue_time);
+            in.get(r.seq);
+            r.process = in.get_process();
+            r.served = false;
+        }
+    }
+
+    string to_string() {
+        const char kinds[] = {'F', 'S', 'D'};
+        string s = kinds[discipline] + std::to_string(concurrency);
+        if (discipline == IO_DEADLINE)
+            s += ":" + std::to_string(expire);
+        return s;
+    }
+};
+
+/**
+ * Global variables
+ */
+const char *const STATE_STRING[] = {          // convert enums to strings, indexed by Proc_State
+        "BLOCK",    // BLOCKED
+        "CREATED",  // CREATED
+        "PREEMPT",  // PREEMPT
+        "READY",    // READY
+        "RUNNG"};   // RUNNING
+const char CHECKPOINT_MAGIC[8] = {'S', 'C', 'H', 'E', 'D', 'C', 'K', 'P'};
+const uint32_t CHECKPOINT_VERSION = 6;
+thread_local bool COUNT_ALLOCATIONS = false;     // set on a thread while its event loop runs
+thread_local unsigned long HEAP_ALLOCATIONS = 0; // operator new calls on this thread while COUNT_ALLOCATIONS is set
+
+#ifndef SCHEDULER_LIBRARY
+/** command line settings, turned into SimulationOptions by cli_options **/
+const char *SCHEDULER_SPEC = "F";           // -s argument, used to build one scheduler per CPU
+const char *EVENT_QUEUE_SPEC = "B";         // -q argument, used to build the event queue of a simulation
+int NUM_CPUS = 1;                           // number of simulated CPUs
+const char *BALANCE_SPEC = "S";             // -b argument, how ready processes are spread over the CPUs
+const char *IO_DEVICE_SPEC = nullptr;       // -D: comma separated IO devices, nullptr keeps IO infinitely parallel
+const char *SWEEP_SPEC = nullptr;           // -S argument, list of scheduler configurations to sweep
+int SWEEP_THREADS = 0;                      // worker threads for a sweep, 0 uses every hardware thread
+int REPLICATIONS = 0;                       // --replications: independent runs of one configuration, 0 for a single run
+bool VERBOSE = false;                       // flag to display extra information for every event
+bool SHOW_ALLOC_STATS = false;              // -a: report the heap traffic of the event loop, warm and steady
+bool SHOW_SCHED_DETAILS = false;            // collect and print the hot path counters
+bool SHOW_PERCENTILES = false;              // -Q: print latency percentiles after the SUM line
+bool SHOW_EVENT_TRACE = false;              // write every transition to TRACE_FILE
+const char *TRACE_FILE = "scheduler.trace"; // -o argument, binary event trace written by -e
+const char *DECODE_TRACE = nullptr;         // -d: print this trace in the format of -v and exit
+const char *GENERATE_SPEC = nullptr;        // -G: write a generated workload to the file arguments and exit
+const char *BENCH_DEPTHS = nullptr;         // -T: queue depths of the hot path benchmark
+bool STREAM_LOADER = false;                 // parse the input files with iostreams instead of mmap
+int LOADER_BENCH_ROUNDS = 0;                // -B: time both loaders this many times and exit
+const char *CONVERT_TO = nullptr;           // -C: write the workload to this binary file and exit
+const char *REPLAY_FILE = nullptr;          // -r: burst replay file, bursts are drawn from rfile without it
+const char *CONVERT_BURSTS = nullptr;       // -X: write a burst listing to this replay file and exit
+bool USE_PRNG = false;                      // -x: draw from the built-in generator instead of rfile
+unsigned long long PRNG_SEED = 0;           // -x argument, seed of the built-in generator
+bool USE_BINARY_CACHE = false;              // load through / refresh inputfile.bin
+bool STREAM_ARRIVALS = false;               // -A: create processes as they arrive from a sorted input
+unsigned long long CHECKPOINT_EVERY = 0;    // --checkpoint-every: events between checkpoints, 0 disables them
+const char *CHECKPOINT_FILE = "scheduler.ckpt"; // --checkpoint-file: where checkpoints are written
+const char *RESTORE_FILE = nullptr;         // --restore: checkpoint to continue from
+
+/** Not implemented these features **/
+bool SHOW_PREEMPTION_TRACE = false;
+bool SHOW_SINGLE_STEP = false;
+#endif
+
+/**
+ * Helper functions
+ */
+
+/**
+ * check if a char* string has a character
+ * @param str - actual string
+ * @param ch - character to be searched
+ */
+bool hasChar(const char *str, char ch) {
+    while (*str != '\0') {
+        if (*str == ch) {
+            return true;
+        }
+        str++;
+    }
+    return false;
+}
+
+#ifndef SCHEDULER_LIBRARY
+/**
+ * Print error message for incorrect input arguments
+ * @param - filename - executable file's name
+ */
+void print_usage(char *filename) {
+    printf("Usage: %s [-v] [-t] [-e] [-p] [-i] [-s sched] [-q queue] [-a] [-c cpus] [-b balance] [-S sweep] [-j threads] [-l] [-B rounds] [-C out.bin] [-k] [-o trace] [-T depths] [-A] [-Q] [-D devices]\n"
+           "       [--checkpoint-every N] [--checkpoint-file F] [--restore F] [--replications K] [--replay F] [--prng seed]\n"
+           "       inputfile randomfile\n"
+           "       %s [options] workload.bin\n"
+           "       %s -d trace\n"
+           "       %s -X out.bursts listing.txt\n"
+           "       %s -G spec workload.bin | -G spec inputfile randomfile\n"
+           "-v enables verbose\n"
+           "-t prints event, event queue, preemption and run queue counters\n"
+           "-e writes every transition to a binary trace file (single runs only)\n"
+           "-p enables E scheduler preemption tracing\n"
+           "-i single steps event by event\n"
+           "-s sched is one of F, L, S, SP (preemptive SRTF), R<quantum>, P<quantum>[:<maxprio>], E<quantum>[:<maxprio>],\n"
+           "   C[<target latency>[:<min granularity>]] (fair scheduler, default C20:2)\n"
+           "-q selects the event queue {L=sorted list, B=binary heap (default), P=pairing heap, C=calendar queue}\n"
+           "-a prints the event queue size and the heap allocations of the event loop, in the run and in a\n"
+           "   repeat of it on the same simulation (single runs only)\n"
+           "-c simulates that many CPUs\n"
+           "-b selects the CPU load balancing {G=global queue, S=work stealing (default), R<interval>=periodic rebalancing}\n"
+           "-S runs a comma separated list of sched specs in parallel, numbers may be ranges a..b (e.g. R1..100,P5:2..16)\n"
+           "-j sets the number of sweep and replication threads (default: all hardware threads)\n"
+           "-l loads the input files with iostreams instead of mmap\n"
+           "-B times the stream and mmap loaders over that many rounds and exits\n"
+           "-C converts inputfile and randomfile into a binary workload file and exits\n"
+           "-k loads through the binary cache inputfile.bin, rebuilding it when stale\n"
+           "-o sets the trace file written by -e (default: scheduler.trace), implies -e\n"
+           "-d prints a trace file in the format of -v and exits\n"
+           "-G writes a generated workload and exits, spec is a comma separated list of n=<count>, seed=<seed>,\n"
+           "   rand=<random values>, arrival=<gap>, total=<cpu time>, cb=<cpu burst>, ib=<io burst>, where each\n"
+           "   distribution is const:v, uniform:lo:hi, exp:mean or pareto:alpha:min\n"
+           "-T times event queue and scheduler operations at the given comma separated queue depths\n"
+           "   and the full run of F, L, S, R, P, E and C on the workload, then exits\n"
+           "-A streams the arrivals of an input sorted by arrival time, memory then depends on the live\n"
+           "   processes only, the per-process lines are left out\n"
+           "-K, --checkpoint-every N saves the simulation state every N events (file: scheduler.ckpt)\n"
+           "-F, --checkpoint-file F sets the checkpoint file\n"
+           "-R, --restore F continues from a checkpoint taken with the same workload and options\n"
+           "-Q prints p50/p90/p99/p99.9 of turnaround, ready queue wait and first dispatch response time\n"
+           "-D queues IO on a comma separated list of devices F<n> (FIFO), S<n> (shortest request first) or\n"
+           "   D<n>[:<expiry>] (shortest first until a request waits expiry, default 50), each serving n requests\n"
+           "   at a time, a process uses device pid %% count\n"
+           "-N, --replications K runs K copies of the configuration, each drawing from its own stream of the\n"
+           "   built-in generator (seed 0 or the -x seed), and prints the mean and 95%% confidence interval\n"
+           "   of the SUM values\n"
+           "-r, --replay F takes CPU and IO bursts from a burst replay file instead of the random file,\n"
+           "   process pid replays recorded process pid %% count, the random file still sets priorities\n"
+           "-X converts a listing with one line of alternating CPU and IO burst lengths per process\n"
+           "   into a burst replay file and exits\n"
+           "-x, --prng seed draws bursts and priorities from the built-in xoshiro256++ generator instead of\n"
+           "   the random file, which is still read\n",
+           filename, filename, filename, filename, filename);
+}
+#endif
+
+/**
+ * Get the appropriate scheduler based on the arguments
+ * @param - args - string that needs to parsed to fetch the scheduler type
+ *
+ * @returns - the correct Scheduler based on the arguments
+ */
+Scheduler *getScheduler(const char *args) {
+    switch (args[0]) {
+        case 'F':
+            return new FCFSScheduler();
+        case 'L':
+            return new LCFSScheduler();
+        case 'S':
+            if (args[1] == 'P')
+                return new PreemptiveSRTFScheduler();
+            return new SRTFScheduler();
+        case 'R': {
+            int quantum;
+            sscanf(args, "R%d", &quantum);
+            if (quantum <= 0) {
+                throw_error("Invalid scheduler param <%s>", args);
+            }
+            return new RRScheduler(quantum);
+        }
+        case 'P': {
+            int quantum = 0;
+            int maxprio = 0;
+            sscanf(args, "P%d:%d", &quantum, &maxprio);
+            if (quantum <= 0 || (hasChar(args, ':') && maxprio <= 0)) {
+                throw_error("Invalid scheduler param <%s>", args);
+            }
+            return new PriorityScheduler(quantum, maxprio);
+        }
+        case 'E': {
+            int quantum = 0;
+            int maxprio = 0;
+            sscanf(args, "E%d:%d", &quantum, &maxprio);
+            if (quantum <= 0 || (hasChar(args, ':') && maxprio <= 0)) {
+                throw_error("Invalid scheduler param <%s>", args);
+            }
+            return new PreemptivePriorityScheduler(quantum, maxprio);
+        }
+        case 'C': {
+            int latency = 20;
+            int granularity = 2;
+            sscanf(args, "C%d:%d", &latency, &granularity);
+            if (latency <= 0 || granularity <= 0) {
+                throw_error("Invalid scheduler param <%s>", args);
+            }
+            return new CFSScheduler(latency, granularity);
+        }
+        default:
+            throw_error("Unknown Scheduler spec: -v {FLSRPEC}");
+    }
+}
+
+/**
+ * Get the event queue backend based on the arguments
+ * @param - args - string that needs to parsed to fetch the queue type
+ *
+ * @returns - the correct EventQueue based on the arguments
+ */
+EventQueue *getEventQueue(const char *args) {
+    switch (args[0]) {
+        case 'L':
+            return new SortedListEventQueue();
+        case 'B':
+            return new BinaryHeapEventQueue();
+        case 'P':
+            return new PairingHeapEventQueue();
+        case 'C':
+            return new CalendarEventQueue();
+        default:
+            throw_error("Unknown Event Queue spec: -q {LBPC}");
+    }
+}
+
+/**
+ * Get the load balancing policy used with multiple CPUs
+ * @param - args - G (global queue), S (work stealing) or R<interval> (periodic rebalancing)
+ * @param - policy - receives the policy
+ * @param - interval - receives the time between rebalancing passes, 0 unless PERIODIC_REBALANCE
+ */
+void get_balance_policy(const char *args, Balance_Policy &policy, int &interval) {
+    interval = 0;
+    switch (args[0]) {
+        case 'G':
+            policy = GLOBAL_QUEUE;
+            break;
+        case 'S':
+            policy = WORK_STEALING;
+            break;
+        case 'R': {
+            sscanf(args, "R%d", &interval);
+            if (interval <= 0) {
+                throw_error("Invalid balance policy param <%s>", args);
+            }
+            policy = PERIODIC_REBALANCE;
+            break;
+        }
+        default:
+            throw_error("Unknown Balance Policy spec: -b {GSR}");
+    }
+}
+
+/**
+ * Build the IO devices of a -D spec
+ * @param - args - comma separated devices F<n>, S<n> or D<n>[:<expiry>], n defaults to 1
+ * @param - devices - receives one device per item, in order
+ */
+void get_io_devices(const char *args, vector<IODevice> &devices) {
+    const char *p = args;
+    while (true) {
+        IO_Discipline discipline;
+        switch (*p) {
+            case 'F':
+                discipline = IO_FIFO;
+                break;
+            case 'S':
+                discipline = IO_SHORTEST;
+                break;
+            case 'D':
+                discipline = IO_DEADLINE;
+                break;
+            default:
+                throw_error("Unknown IO device spec <%s>: -D {FSD}", args);
+        }
+        p++;
+        int channels = 1;
+        int expiry = 50;
+        char *end;
+        if (isdigit((unsigned char) *p)) {
+            channels = (int) strtol(p, &end, 10);
+            p = end;
+        }
+        if (*p == ':' && discipline == IO_DEADLINE) {
+            expiry = (int) strtol(p + 1, &end, 10);
+            p = end == p + 1 ? p : end;
+        }
+        if (channels <= 0 || expiry <= 0 || (*p != ',' && *p != '\0')) {
+            throw_error("Invalid IO device param <%s>", args);
+        }
+        devices.emplace_back((int) devices.size(), discipline, channels, expiry);
+        if (*p == '\0')
+            break;
+        p++;
+    }
+}
+
+#ifndef SCHEDULER_LIBRARY
+/**
+ * Parse the numbers from the random-number file
+ * @param - filename - random-number file
+ * @param - workload - receives the random numbers
+ */
+void parse_randoms(char *filename, Workload &workload) {
+    fstream rand_file;
+    rand_file.open(filename, ios::in);
+
+    if (!rand_file.is_open()) {
+        throw_error("Not a valid inputfile <%s>", filename);
+    }
+
+    string line;
+    getline(rand_file, line);
+    int rand_count = stoi(line);
+    /** every draw takes a value modulo rand_count **/
+    if (rand_count <= 0) {
+        throw_error("Not a valid random file <%s>", filename);
+    }
+
+    int *values = workload.resize_randvals(rand_count);
+    for (int i = 0; i < rand_count; i++) {
+        getline(rand_file, line);
+        values[i] = stoi(line);
+    }
+}
+
+/**
+ * Parse the process information from the input file
+ * @param - filename - input file
+ * @param - workload - receives one ProcessSpec per line
+ */
+void load_processes(char *filename, Workload &workload) {
+    fstream input_file;
+
+    input_file.open(filename, ios::in);
+
+    if (!input_file.is_open()) {
+        throw_error("Not a valid inputfile <%s>", filename);
+    }
+
+    string line;
+    while (getline(input_file, line)) {
+        ProcessSpec spec = {0, 0, 0, 0};
+        sscanf(line.c_str(), "%d %d %d %d", &spec.arrival_time, &spec.total_cpu_time, &spec.cpu_burst, &spec.io_burst);
+        workload.add_process(spec);
+    }
+}
+#endif
+
+/**
+ * Parse a decimal integer the way sscanf's %d does: skip blanks, accept a sign
+ * @param - p - start of the text
+ * @param - end - end of the current line
+ * @param - value - receives the number
+ *
+ * @returns - pointer past the number, or nullptr if the line has no number at p
+ */
+const char *scan_int(const char *p, const char *end, int &value) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\v' || *p == '\f'))
+        p++;
+    if (p < end && *p == '+')
+        p++;
+    from_chars_result res = from_chars(p, end, value);
+    if (res.ec != errc()) {
+        return nullptr;
+    }
+    return res.ptr;
+}
+
+/**
+ * Parse the numbers from the random-number file through a memory mapping
+ * @param - filename - random-number file
+ * @param - workload - receives the random numbers
+ */
+void parse_randoms_mmap(char *filename, Workload &workload) {
+    MappedFile file;
+    if (!file.open(filename)) {
+        throw_error("Not a valid inputfile <%s>", filename);
+    }
+
+    const char *p = file.begin();
+    const char *end = file.end();
+    int rand_count = 0;
+    p = p ? scan_int(p, end, rand_count) : nullptr;
+    if (p == nullptr || rand_count <= 0) {
+        throw_error("Not a valid random file <%s>", filename);
+    }
+
+    int *values = workload.resize_randvals(rand_count);
+    for (int i = 0; i < rand_count; i++) {
+        /** every number sits on its own line **/
+        p = (const char *) memchr(p, '\n', end - p);
+        if (p == nullptr || (p = scan_int(p + 1, end, values[i])) == nullptr) {
+            throw_error("Not a valid random file <%s>", filename);
+        }
+    }
+}
+
+/**
+ * Parse the process information from the input file through a memory mapping
+ * @param - filename - input file
+ * @param - workload - receives one ProcessSpec per line
+ */
+void load_processes_mmap(char *filename, Workload &workload) {
+    MappedFile file;
+    if (!file.open(filename)) {
+        throw_error("Not a valid inputfile <%s>", filename);
+    }
+
+    const char *p = file.begin();
+    const char *end = file.end();
+    if (p == end) {
+        return;
+    }
+
+    /** size the table once: one process per line, the last line may lack its newline **/
+    size_t lines = 0;
+    for (const char *q = p; (q = (const char *) memchr(q, '\n', end - q)); q++)
+        lines++;
+    if (end[-1] != '\n')
+        lines++;
+    size_t first = workload.process_count;
+    ProcessSpec *spec = workload.resize_processes(first + lines) + first;
+
+    while (p < end) {
+        const char *eol = (const char *) memchr(p, '\n', end - p);
+        if (eol == nullptr)
+            eol = end;
+
+        /** like sscanf, stop at the first field that is not a number and leave the rest 0 **/
+        int fields[4] = {0, 0, 0, 0};
+        const char *q = p;
+        for (int &field: fields) {
+            if ((q = scan_int(q, eol, field)) == nullptr)
+                break;
+        }
+        *spec++ = {fields[0], fields[1], fields[2], fields[3]};
+        p = eol + 1;
+    }
+}
+
+/**
+ * Lazy reader of the processes of a workload in arrival order, used to
+ * stream arrivals into a simulation instead of creating every process up
+ * front. Reads either a text input file through its own mapping or the
+ * process array of a mapped binary workload, and hands the pages it has
+ * read back to the kernel so resident memory does not grow with the file.
+ */
+class ArrivalCursor {
+private:
+    MappedFile file;                       // text input, unused for a binary workload
+    const char *pos = nullptr;             // next line of the text input
+    const char *end = nullptr;
+    const ProcessSpec *specs = nullptr;    // process array of a binary workload
+    size_t index = 0;                      // processes handed out so far
+    size_t count = 0;
+    const char *released = nullptr;        // start of the pages not yet handed back
+    ProcessSpec upcoming{};                // next process, valid while index < count
+    int last_arrival = 0;
+
+    /** drop the pages that lie entirely before p, every 16MB **/
+    void release_until(const char *p) {
+        const uintptr_t PAGE = 4096;
+        if (p - released < (1 << 24))
+            return;
+        auto from = (uintptr_t) released & ~(PAGE - 1);
+        auto to = (uintptr_t) p & ~(PAGE - 1);
+        if (to > from)
+            madvise((void *) from, to - from, MADV_DONTNEED);
+        released = (const char *) to;
+    }
+
+    void read_upcoming() {
+        if (index == count) {
+            return;
+        }
+        if (specs) {
+            upcoming = specs[index];
+            release_until((const char *) (specs + index));
+        } else {
+            const char *eol = (const char *) memchr(pos, '\n', end - pos);
+            if (eol == nullptr)
+                eol = end;
+            /** same line format as load_processes_mmap **/
+            int fields[4] = {0, 0, 0, 0};
+            const char *q = pos;
+            for (int &field: fields) {
+                if ((q = scan_int(q, eol, field)) == nullptr)
+                    break;
+            }
+            upcoming = {fields[0], fields[1], fields[2], fields[3]};
+            pos = eol + 1;
+            release_until(pos);
+        }
+        if (upcoming.arrival_time < last_arrival) {
+            throw_error("Streaming arrivals needs an input sorted by arrival time, process %zu arrives at %d after %d",
+                   index, upcoming.arrival_time, last_arrival);
+        }
+        last_arrival = upcoming.arrival_time;
+    }
+
+public:
+    /**
+     * Read processes from a text input file
+     * @param - filename - input file
+     *
+     * @returns - false if the file cannot be mapped
+     */
+    bool open(const char *filename) {
+        if (!file.open(filename)) {
+            return false;
+        }
+        pos = released = file.begin();
+        end = file.end();
+        if (pos != end) {
+            /** one process per line, the last line may lack its newline **/
+            for (const char *q = pos; (q = (const char *) memchr(q, '\n', end - q)); q++)
+                count++;
+            if (end[-1] != '\n')
+                count++;
+            madvise((void *) pos, end - pos, MADV_DONTNEED); // the counting pass paged the file in
+        }
+        read_upcoming();
+        return true;
+    }
+
+    /**
+     * Read processes from the process array of a binary workload
+     * @param - workload - workload mapped by load_binary
+     */
+    void open(const Workload &workload) {
+        specs = workload.processes;
+        count = workload.process_count;
+        released = (const char *) specs;
+        read_upcoming();
+    }
+
+    /**
+     * Total number of processes, including the ones already handed out
+     */
+    [[nodiscard]] size_t size() const {
+        return count;
+    }
+
+    [[nodiscard]] bool has_next() const {
+        return index < count;
+    }
+
+    /**
+     * Arrival time of the next process, only valid if has_next
+     */
+    [[nodiscard]] int peek_time() const {
+        return upcoming.arrival_time;
+    }
+
+    /**
+     * Take the next process, only valid if has_next
+     */
+    ProcessSpec next() {
+        ProcessSpec spec = upcoming;
+        index++;
+        read_upcoming();
+        return spec;
+    }
+};
+
+/**
+ * Layout of a burst replay file (all fields little-endian): this header,
+ * pair_count BurstPair records grouped by process, then process_count + 1
+ * uint64 indexes, process i owning the pairs [index[i], index[i + 1])
+ */
+struct BurstHeader {
+    char magic[8];          // BURST_MAGIC
+    uint32_t version;       // BURST_VERSION
+    uint32_t reserved;
+    uint64_t process_count; // recorded processes
+    uint64_t pair_count;    // BurstPair records following the header
+};
+
+/**
+ * One recorded CPU burst and the IO burst that followed it
+ */
+struct BurstPair {
+    int32_t cpu;
+    int32_t io;
+};
+
+const char BURST_MAGIC[8] = {'S', 'C', 'H', 'E', 'D', 'B', 'R', 'S'};
+const uint32_t BURST_VERSION = 1;
+
+static_assert(sizeof(BurstHeader) == 32, "BurstHeader must be 32 bytes");
+static_assert(sizeof(BurstPair) == 2 * sizeof(int32_t), "BurstPair must be two packed int32");
+
+/**
+ * Recorded bursts replayed in place of the random draws, read through a
+ * mapping so only the pages the simulation reaches are ever loaded.
+ * Process pid replays recorded process pid % process_count, and starts
+ * over when it has used up its recording.
+ */
+class BurstTrace {
+private:
+    MappedFile mapping;
+    const BurstPair *pairs = nullptr;
+    const uint64_t *index = nullptr;
+
+public:
+    size_t process_count = 0;
+    size_t pair_count = 0;
+
+    /**
+     * @param - filename - burst replay file written by -X
+     *
+     * @returns - false if the file is missing, truncated or not a burst replay file
+     */
+    bool open(const char *filename) {
+        if (!mapping.open(filename)) {
+            return false;
+        }
+        size_t length = mapping.end() - mapping.begin();
+        BurstHeader header{};
+        if (length < sizeof(BurstHeader)) {
+            return false;
+        }
+        memcpy(&header, mapping.begin(), sizeof(BurstHeader));
+        if (memcmp(header.magic, BURST_MAGIC, sizeof(BURST_MAGIC)) != 0 || header.version != BURST_VERSION ||
+            header.process_count == 0) {
+            return false;
+        }
+        size_t expected = sizeof(BurstHeader) + header.pair_count * sizeof(BurstPair) +
+                          (header.process_count + 1) * sizeof(uint64_t);
+        if (length != expected) {
+            return false;
+        }
+        /** the cursors of the processes move independently, keep the default readahead **/
+        mapping.advise(MADV_NORMAL);
+        pairs = reinterpret_cast<const BurstPair *>(mapping.begin() + sizeof(BurstHeader));
+        index = reinterpret_cast<const uint64_t *>(pairs + header.pair_count);
+        process_count = header.process_count;
+        pair_count = header.pair_count;
+        return index[0] == 0 && index[process_count] == pair_count;
+    }
+
+    /**
+     * @param - pid - simulated process
+     * @param - cursor - pairs the process has used so far
+     *
+     * @returns - the pair the process replays next
+     */
+    [[nodiscard]] const BurstPair &next(int pid, unsigned long long cursor) const {
+        size_t p = pid % process_count;
+        uint64_t first = index[p];
+        uint64_t n = index[p + 1] - first;
+        if (first + n > pair_count || n == 0) {
+            throw_error("Recorded process %zu has no valid bursts", p);
+        }
+        return pairs[first + cursor % n];
+    }
+};
+
+#ifndef SCHEDULER_LIBRARY
+/**
+ * Convert a text listing of recorded bursts into a burst replay file. Every
+ * line is one process, its CPU and IO burst lengths alternating (cb ib cb
+ * ib ...), e.g. per-task run and sleep times taken from perf sched
+ * timehist; lines starting with # are skipped.
+ * @param - textfile - burst listing
+ * @param - filename - burst replay file to write
+ * @param - header - receives the header written
+ *
+ * @returns - false if a file cannot be read or written, throws on a malformed line
+ */
+bool write_bursts(const char *textfile, const char *filename, BurstHeader &header) {
+    MappedFile text;
+    if (!text.open(textfile)) {
+        return false;
+    }
+    string tmp = string(filename) + ".tmp";
+    FILE *out = fopen(tmp.c_str(), "wb");
+    if (out == nullptr) {
+        return false;
+    }
+    setvbuf(out, nullptr, _IOFBF, 1 << 20);
+    header = BurstHeader{};
+    memcpy(header.magic, BURST_MAGIC, sizeof(BURST_MAGIC));
+    header.version = BURST_VERSION;
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+
+    /** the pairs are streamed out, only the index is kept in memory **/
+    vector<uint64_t> index(1, 0);
+    const char *pos = text.begin();
+    const char *end = text.end();
+    int line = 0;
+    while (ok && pos < end) {
+        const char *eol = (const char *) memchr(pos, '\n', end - pos);
+        if (eol == nullptr)
+            eol = end;
+        line++;
+        const char *q = pos;
+        pos = eol + 1;
+        while (q < eol && isspace((unsigned char) *q))
+            q++;
+        if (q == eol || *q == '#')
+            continue;
+        int values = 0;
+        BurstPair pair{};
+        int burst;
+        while ((q = scan_int(q, eol, burst)) != nullptr) {
+            if (burst <= 0) {
+                throw_error("Invalid burst %d in line %d of <%s>", burst, line, textfile);
+            }
+            if (values++ % 2 == 0) {
+                pair.cpu = burst;
+            } else {
+                pair.io = burst;
+                ok = ok && fwrite(&pair, sizeof(pair), 1, out) == 1;
+            }
+        }
+        if (values == 0) {
+            throw_error("Line %d of <%s> holds no bursts", line, textfile);
+        }
+        if (values % 2 != 0) {
+            throw_error("Line %d of <%s> ends with a CPU burst, every CPU burst needs the IO burst after it",
+                   line, textfile);
+        }
+        header.pair_count += values / 2;
+        index.push_back(header.pair_count);
+    }
+    header.process_count = index.size() - 1;
+
+    ok = ok && fwrite(index.data(), sizeof(uint64_t), index.size(), out) == index.size() &&
+         fseek(out, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, out) == 1;
+    ok = fclose(out) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), filename) != 0) {
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Modification time and size of a file
+ * @param - filename - file to look at
+ * @param - mtime - receives the modification time in nanoseconds
+ * @param - size - receives the size in bytes
+ *
+ * @returns - false if the file cannot be stat'ed
+ */
+bool file_stamp(const char *filename, int64_t &mtime, int64_t &size) {
+    struct stat st{};
+    if (stat(filename, &st) < 0) {
+        return false;
+    }
+    mtime = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    size = st.st_size;
+    return true;
+}
+
+/**
+ * Write a workload in the binary format, through a temporary file that is
+ * renamed into place so readers never see a partial file
+ * @param - filename - binary file to create
+ * @param - workload - parsed workload
+ * @param - inputfile - input file the workload was parsed from
+ * @param - randfile - random-number file the workload was parsed from
+ *
+ * @returns - false if the file could not be written
+ */
+bool write_binary(const char *filename, const Workload &workload, const char *inputfile, const char *randfile) {
+    BinaryHeader header{};
+    memcpy(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+    header.version = BINARY_VERSION;
+    header.rand_count = (uint32_t) workload.rand_count;
+    header.process_count = workload.process_count;
+    if (!file_stamp(inputfile, header.input_mtime, header.input_size) ||
+        !file_stamp(randfile, header.rand_mtime, header.rand_size)) {
+        return false;
+    }
+
+    string tmp = string(filename) + ".tmp";
+    FILE *out = fopen(tmp.c_str(), "wb");
+    if (out == nullptr) {
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+              fwrite(workload.randvals, sizeof(int32_t), workload.rand_count, out) == workload.rand_count &&
+              fwrite(workload.processes, sizeof(ProcessSpec), workload.process_count, out) == workload.process_count;
+    ok = fclose(out) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), filename) != 0) {
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+#endif
+
+/**
+ * Map a binary workload file
+ * @param - filename - binary workload file
+ * @param - workload - receives the random numbers and processes
+ */
+void load_binary(char *filename, Workload &workload) {
+    BinaryHeader header{};
+    if (!workload.map_binary(filename, header)) {
+        throw_error("Not a valid binary workload <%s>", filename);
+    }
+}
+
+#ifndef SCHEDULER_LIBRARY
+/**
+ * Load the text files through a binary cache next to the input file
+ * (inputfile.bin). The cache is used when the stamps in its header match
+ * both text files, otherwise the text is parsed and the cache rewritten.
+ * @param - inputfile - input file
+ * @param - randfile - random-number file
+ * @param - workload - receives the random numbers and processes
+ */
+void load_cached(char *inputfile, char *randfile, Workload &workload) {
+    string cache = string(inputfile) + ".bin";
+    BinaryHeader header{};
+    int64_t input_mtime, input_size, rand_mtime, rand_size;
+    if (file_stamp(inputfile, input_mtime, input_size) && file_stamp(randfile, rand_mtime, rand_size)) {
+        Workload cached;
+        if (cached.map_binary(cache.c_str(), header) &&
+            header.input_mtime == input_mtime && header.input_size == input_size &&
+            header.rand_mtime == rand_mtime && header.rand_size == rand_size) {
+            workload.map_binary(cache.c_str(), header);
+            return;
+        }
+    }
+
+    parse_randoms_mmap(randfile, workload);
+    load_processes_mmap(inputfile, workload);
+    write_binary(cache.c_str(), workload, inputfile, randfile); // a cache that cannot be written is not an error
+}
+
+/**
+ * Check whether a string ends with a suffix
+ * @param - str - string to check
+ * @param - suffix - expected ending
+ */
+bool has_suffix(const char *str, const char *suffix) {
+    size_t len = strlen(str), suffix_len = strlen(suffix);
+    return len >= suffix_len && strcmp(str + len - suffix_len, suffix) == 0;
+}
+
+/**
+ * Check that two workloads hold the same random numbers and processes
+ */
+bool same_workload(const Workload &a, const Workload &b) {
+    if (a.rand_count != b.rand_count || a.process_count != b.process_count ||
+        !equal(a.randvals, a.randvals + a.rand_count, b.randvals)) {
+        return false;
+    }
+    for (size_t i = 0; i < a.process_count; i++) {
+        const ProcessSpec &x = a.processes[i], &y = b.processes[i];
+        if (x.arrival_time != y.arrival_time || x.total_cpu_time != y.total_cpu_time ||
+            x.cpu_burst != y.cpu_burst || x.io_burst != y.io_burst)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Time the stream, mmap and binary loaders on the same files and check that they agree
+ * @param - inputfile - input file
+ * @param - randfile - random-number file
+ * @param - rounds - number of loads per loader, the fastest one is reported
+ */
+void benchmark_loaders(char *inputfile, char *randfile, int rounds) {
+    const char *names[3] = {"stream", "mmap", "binary"};
+    double best[3] = {1e300, 1e300, 1e300};
+    Workload loaded[3];
+
+    /** the binary loader reads a temporary conversion of the text files **/
+    char binfile[] = "/tmp/scheduler-bench-XXXXXX";
+    int fd = mkstemp(binfile);
+    if (fd < 0) {
+        throw_error("Cannot create temporary file <%s>", binfile);
+    }
+    close(fd);
+    {
+        Workload text;
+        parse_randoms_mmap(randfile, text);
+        load_processes_mmap(inputfile, text);
+        if (!write_binary(binfile, text, inputfile, randfile)) {
+            throw_error("Cannot write binary workload <%s>", binfile);
+        }
+    }
+
+    for (int r = 0; r < rounds; r++) {
+        for (int loader = 0; loader < 3; loader++) {
+            Workload scratch;
+            Workload &workload = r == 0 ? loaded[loader] : scratch;
+            auto start = chrono::steady_clock::now();
+            if (loader == 0) {
+                parse_randoms(randfile, workload);
+                load_processes(inputfile, workload);
+            } else if (loader == 1) {
+                parse_randoms_mmap(randfile, workload);
+                load_processes_mmap(inputfile, workload);
+            } else {
+                load_binary(binfile, workload);
+            }
+            chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+            best[loader] = min(best[loader], elapsed.count());
+        }
+    }
+    remove(binfile);
+
+    printf("LOAD: %zu processes %zu randoms\n", loaded[0].process_count, loaded[0].rand_count);
+    for (int loader = 0; loader < 3; loader++)
+        printf("%-7s %10.3f ms (%.1fx)\n", names[loader], best[loader], best[0] / best[loader]);
+    if (!same_workload(loaded[0], loaded[1]) || !same_workload(loaded[0], loaded[2])) {
+        throw_error("loaders disagree");
+    }
+}
+#endif
+
+/**
+ * Seeded 64-bit random numbers for the workload generator and benchmarks (splitmix64)
+ */
+class SplitMix64 {
+private:
+    uint64_t state;
+
+public:
+    explicit SplitMix64(uint64_t seed) {
+        state = seed;
+    }
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    /**
+     * @returns - uniform double in [0, 1)
+     */
+    double uniform() {
+        return (double) (next() >> 11) * 0x1.0p-53;
+    }
+};
+
+/**
+ * Built-in random stream replacing the random file (xoshiro256++). LANES
+ * generators, spaced 2^128 draws apart by jump, are stepped side by side
+ * over arrays of their state words, so refilling a block of BLOCK values
+ * is a loop the compiler vectorizes. Each 64-bit output yields two 32-bit
+ * values. Trivially copyable, checkpoints write it as it is.
+ */
+class Xoshiro256 {
+private:
+    static const int LANES = 8;
+    static const int BLOCK = 1024;
+
+    uint64_t s0[LANES], s1[LANES], s2[LANES], s3[LANES];
+    uint32_t block[BLOCK];
+    int next_value = BLOCK;
+
+    static uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    /** advance a generator by 2^128 draws, or by 2^192 with LONG_JUMP **/
+    static constexpr uint64_t JUMP[] = {0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+                                        0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL};
+    static constexpr uint64_t LONG_JUMP[] = {0x76e15d3efefdcbbfULL, 0xc5004e441c522fb3ULL,
+                                             0x77710069854ee241ULL, 0x39109bb02acbe635ULL};
+
+    static void jump(uint64_t (&s)[4], const uint64_t (&polynomial)[4] = JUMP) {
+        uint64_t t[4] = {};
+        for (uint64_t word: polynomial) {
+            for (int b = 0; b < 64; b++) {
+                if (word & (1ULL << b)) {
+                    for (int k = 0; k < 4; k++)
+                        t[k] ^= s[k];
+                }
+                uint64_t shifted = s[1] << 17;
+                s[2] ^= s[0];
+                s[3] ^= s[1];
+                s[1] ^= s[2];
+                s[0] ^= s[3];
+                s[2] ^= shifted;
+                s[3] = rotl(s[3], 45);
+            }
+        }
+        for (int k = 0; k < 4; k++)
+            s[k] = t[k];
+    }
+
+    void refill() {
+        for (int i = 0; i < BLOCK; i += 2 * LANES) {
+            for (int l = 0; l < LANES; l++) {
+                uint64_t result = rotl(s0[l] + s3[l], 23) + s0[l];
+                uint64_t shifted = s1[l] << 17;
+                s2[l] ^= s0[l];
+                s3[l] ^= s1[l];
+                s1[l] ^= s2[l];
+                s0[l] ^= s3[l];
+                s2[l] ^= shifted;
+                s3[l] = rotl(s3[l], 45);
+                block[i + l] = (uint32_t) result;
+                block[i + LANES + l] = (uint32_t) (result >> 32);
+            }
+        }
+        next_value = 0;
+    }
+
+    /**
+     * Multiply-shift range reduction (Lemire): the top half of value * range
+     * is the result, and the 2^32 % range values whose bottom half falls
+     * below that threshold are rejected so every result is equally likely.
+     * Not division-free: computing the threshold takes a division, but only
+     * when the bottom half is below range, for range / 2^32 of the values.
+     */
+    static bool reduce(uint32_t value, uint32_t range, uint32_t &result) {
+        uint64_t m = (uint64_t) value * range;
+        result = (uint32_t) (m >> 32);
+        return (uint32_t) m >= range || (uint32_t) m >= (0u - range) % range;
+    }
+
+public:
+    /**
+     * @param - seed - seed of the stream, expanded by splitmix64
+     * @param - stream - index of the stream, streams of one seed do not overlap
+     * @param - priorities - take the priority draws of the stream: its lanes
+     *                       2^192 draws on, past the burst lanes of every stream
+     */
+    void seed(uint64_t seed, uint64_t stream, bool priorities = false) {
+        SplitMix64 expand(seed);
+        uint64_t s[4] = {expand.next(), expand.next(), expand.next(), expand.next()};
+        if (priorities)
+            jump(s, LONG_JUMP);
+        for (uint64_t k = 0; k < stream * LANES; k++)
+            jump(s);
+        for (int l = 0; l < LANES; l++) {
+            s0[l] = s[0];
+            s1[l] = s[1];
+            s2[l] = s[2];
+            s3[l] = s[3];
+            jump(s);
+        }
+        next_value = BLOCK;
+    }
+
+    /**
+     * @returns - uniform value in [0, range), range at least 1
+     */
+    uint32_t bounded(uint32_t range) {
+        uint32_t result;
+        do {
+            if (next_value == BLOCK)
+                refill();
+        } while (!reduce(block[next_value++], range, result));
+        return result;
+    }
+};
+
+/**
+ * Distribution of non-negative integers given as
+ * const:v, uniform:lo:hi, exp:mean or pareto:alpha:min
+ */
+struct Distribution {
+    char kind = 'c';
+    double a = 0;
+    double b = 0;
+
+    /**
+     * @param - spec - distribution spec
+     *
+     * @returns - false if the spec is not valid
+     */
+    bool parse(const char *spec) {
+        if (sscanf(spec, "const:%lf", &a) == 1) {
+            kind = 'c';
+            return a >= 0;
+        }
+        if (sscanf(spec, "uniform:%lf:%lf", &a, &b) == 2) {
+            kind = 'u';
+            return a >= 0 && b >= a;
+        }
+        if (sscanf(spec, "exp:%lf", &a) == 1) {
+            kind = 'e';
+            return a > 0;
+        }
+        if (sscanf(spec, "pareto:%lf:%lf", &a, &b) == 2) {
+            kind = 'p';
+            return a > 0 && b > 0;
+        }
+        return false;
+    }
+
+    int sample(SplitMix64 &rng) const {
+        double v;
+        switch (kind) {
+            case 'u':
+                return (int) a + (int) (rng.next() % (uint64_t) (b - a + 1));
+            case 'e':
+                v = -a * log(1.0 - rng.uniform());
+                break;
+            case 'p':
+                v = b / pow(1.0 - rng.uniform(), 1.0 / a);
+                break;
+            default:
+                return (int) a;
+        }
+        return (int) min(v, 1e8); // keep heavy tails from overflowing the simulated clock
+    }
+};
+
+/**
+ * Parameters of a generated workload, parsed from a comma separated list of
+ * key=value pairs, e.g. n=1000000,seed=7,arrival=exp:5,total=pareto:1.5:10
+ */
+struct GeneratorSpec {
+    uint64_t count = 1000;        // n: number of processes
+    uint64_t seed = 1;            // seed: same seed, same workload
+    uint32_t rand_count = 40000;  // rand: random values in the random file
+    Distribution arrival;         // arrival: gap between consecutive arrivals
+    Distribution total;           // total: total cpu time
+    Distribution cpu_burst;       // cb: cpu burst parameter
+    Distribution io_burst;        // ib: io burst parameter
+
+    GeneratorSpec() {
+        arrival.parse("exp:5");
+        total.parse("uniform:1:20");
+        cpu_burst.parse("uniform:1:10");
+        io_burst.parse("uniform:1:10");
+    }
+
+    /**
+     * @param - spec - -G argument
+     *
+     * @returns - false if a key or value is not valid
+     */
+    bool parse(const char *spec) {
+        string s(spec);
+        size_t pos = 0;
+        while (pos <= s.size()) {
+            size_t end = s.find(',', pos);
+            if (end == string::npos)
+                end = s.size();
+            string item = s.substr(pos, end - pos);
+            pos = end + 1;
+            size_t eq = item.find('=');
+            if (eq == string::npos) {
+                return false;
+            }
+            string key = item.substr(0, eq);
+            const char *value = item.c_str() + eq + 1;
+            bool ok;
+            if (key == "n") {
+                count = strtoull(value, nullptr, 10);
+                ok = count > 0;
+            } else if (key == "seed") {
+                seed = strtoull(value, nullptr, 10);
+                ok = true;
+            } else if (key == "rand") {
+                rand_count = (uint32_t) strtoul(value, nullptr, 10);
+                ok = rand_count > 0;
+            } else if (key == "arrival") {
+                ok = arrival.parse(value);
+            } else if (key == "total") {
+                ok = total.parse(value);
+            } else if (key == "cb") {
+                ok = cpu_burst.parse(value);
+            } else if (key == "ib") {
+                ok = io_burst.parse(value);
+            } else {
+                ok = false;
+            }
+            if (!ok) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+#ifndef SCHEDULER_LIBRARY
+/**
+ * Write a generated workload, either as one binary workload file (.bin) or as
+ * an input file and a random file. Processes are streamed out in arrival
+ * order, so even 10^8 processes need no more memory than one chunk.
+ * @param - spec - generator parameters
+ * @param - inputfile - binary workload or text input file
+ * @param - randfile - text random file, unused for a binary workload
+ */
+void generate_workload(const GeneratorSpec &spec, const char *inputfile, const char *randfile) {
+    bool binary = has_suffix(inputfile, ".bin");
+    SplitMix64 rng(spec.seed);
+
+    vector<int32_t> randvals(spec.rand_count);
+    for (int32_t &v: randvals)
+        v = (int32_t) (rng.next() >> 33);
+
+    string tmp = string(inputfile) + ".tmp";
+    FILE *out = fopen(binary ? tmp.c_str() : inputfile, binary ? "wb" : "w");
+    if (out == nullptr) {
+        throw_error("Cannot write workload <%s>", inputfile);
+    }
+    setvbuf(out, nullptr, _IOFBF, 1 << 20);
+
+    bool ok = true;
+    if (binary) {
+        BinaryHeader header{};
+        memcpy(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+        header.version = BINARY_VERSION;
+        header.rand_count = spec.rand_count;
+        header.process_count = spec.count;
+        ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+             fwrite(randvals.data(), sizeof(int32_t), randvals.size(), out) == randvals.size();
+    } else {
+        FILE *rand_out = fopen(randfile, "w");
+        if (rand_out == nullptr) {
+            throw_error("Cannot write workload <%s>", randfile);
+        }
+        fprintf(rand_out, "%u\n", spec.rand_count);
+        for (int32_t v: randvals)
+            fprintf(rand_out, "%d\n", v);
+        ok = fclose(rand_out) == 0;
+    }
+
+    const size_t CHUNK = 1 << 16;
+    vector<ProcessSpec> chunk;
+    chunk.reserve(CHUNK);
+    long long arrival = 0;
+    for (uint64_t i = 0; i < spec.count && ok; i++) {
+        arrival += spec.arrival.sample(rng);
+        if (arrival > INT32_MAX) {
+            throw_error("Arrival times overflow after %llu processes, use a smaller arrival gap",
+                   (unsigned long long) i);
+        }
+        ProcessSpec p{};
+        p.arrival_time = (int) arrival;
+        p.total_cpu_time = max(1, spec.total.sample(rng));
+        p.cpu_burst = max(1, spec.cpu_burst.sample(rng));
+        p.io_burst = max(1, spec.io_burst.sample(rng));
+        chunk.push_back(p);
+        if (chunk.size() == CHUNK || i + 1 == spec.count) {
+            if (binary) {
+                ok = fwrite(chunk.data(), sizeof(ProcessSpec), chunk.size(), out) == chunk.size();
+            } else {
+                for (const ProcessSpec &c: chunk)
+                    fprintf(out, "%d %d %d %d\n", c.arrival_time, c.total_cpu_time, c.cpu_burst, c.io_burst);
+            }
+            chunk.clear();
+        }
+    }
+    ok = fclose(out) == 0 && ok;
+    if (binary && (!ok || rename(tmp.c_str(), inputfile) != 0)) {
+        remove(tmp.c_str());
+        ok = false;
+    }
+    if (!ok) {
+        throw_error("Cannot write workload <%s>", inputfile);
+    }
+}
+#endif
+
+/**
+ * Fixed-size, mergeable histogram of non-negative ints for quantiles, with
+ * log-spaced buckets in the style of an HDR histogram: values below 2^PRECISION
+ * get a bucket each, larger values share a bucket with the values that agree
+ * in their top PRECISION + 1 bits, so a quantile is off by less than 2^-PRECISION
+ */
+class QuantileSketch {
+private:
+    static const int PRECISION = 7;
+    static const int SUB = 1 << PRECISION;
+    static const int BUCKETS = SUB + (31 - PRECISION) * SUB;
+
+    unsigned long long counts[BUCKETS] = {};
+    unsigned long long total = 0;
+    int max_value = 0;
+
+    static int bucket_of(int v) {
+        if (v < SUB)
+            return v;
+        int msb = 31 - __builtin_clz((unsigned) v);
+        int shift = msb - PRECISION;
+        return SUB + shift * SUB + ((v >> shift) & (SUB - 1));
+    }
+
+    /** middle of the range of values that fall into a bucket **/
+    static int value_of(int bucket) {
+        if (bucket < SUB)
+            return bucket;
+        int shift = (bucket - SUB) / SUB;
+        int low = (SUB + (bucket - SUB) % SUB) << shift;
+        return low + ((1 << shift) >> 1);
+    }
+
+public:
+    void add(int v) {
+        v = max(v, 0);
+        counts[bucket_of(v)]++;
+        total++;
+        max_value = max(max_value, v);
+    }
+
+    /**
+     * Fold the values of another sketch into this one, e.g. from a parallel run
+     */
+    void merge(const QuantileSketch &other) {
+        for (int b = 0; b < BUCKETS; b++)
+            counts[b] += other.counts[b];
+        total += other.total;
+        max_value = max(max_value, other.max_value);
+    }
+
+    /**
+     * @param - q - quantile in [0, 1]
+     *
+     * @returns - approximate value below which a fraction q of the values lie, 0 for an empty sketch
+     */
+    [[nodiscard]] int quantile(double q) const {
+        if (total == 0) {
+            return 0;
+        }
+        auto rank = (unsigned long long) ceil(q * (double) total);
+        rank = max(rank, 1ULL);
+        unsigned long long seen = 0;
+        for (int b = 0; b < BUCKETS; b++) {
+            seen += counts[b];
+            if (seen >= rank)
+                return min(value_of(b), max_value);
+        }
+        return max_value;
+    }
+
+    [[nodiscard]] unsigned long long size() const {
+        return total;
+    }
+
+    [[nodiscard]] int largest() const {
+        return max_value;
+    }
+
+    [[nodiscard]] Percentiles percentiles() const {
+        return {quantile(0.5), quantile(0.9), quantile(0.99), quantile(0.999), max_value};
+    }
+};
+
+#ifndef SCHEDULER_LIBRARY
+/**
+ * Print the -Q lines
+ * @param - prefix - printed before every line, e.g. the sweep configuration
+ */
+void print_percentiles(const char *prefix, const Percentiles &turnaround, const Percentiles &ready_wait,
+                       const Percentiles &response) {
+    const char *names[] = {"turnaround", "ready_wait", "response"};
+    const Percentiles *values[] = {&turnaround, &ready_wait, &response};
+    for (int i = 0; i < 3; i++) {
+        const Percentiles &v = *values[i];
+        printf("%sPCTL %-10s p50=%d p90=%d p99=%d p99.9=%d max=%d\n", prefix, names[i],
+               v.p50, v.p90, v.p99, v.p999, v.max);
+    }
+}
+#endif
+
+}  // namespace
+
+/**
+ * Latency distributions of finished processes, printed by -Q
+ */
+struct LatencyStats {
+    QuantileSketch turnaround;  // arrival to finish
+    QuantileSketch ready_wait;  // total time spent in the ready queue
+    QuantileSketch response;    // arrival to first dispatch
+
+    void merge(const LatencyStats &other) {
+        turnaround.merge(other.turnaround);
+        ready_wait.merge(other.ready_wait);
+        response.merge(other.response);
+    }
+};
+
+namespace {
+
+/**
+ * Header of a binary event trace written by -e
+ */
+struct TraceHeader {
+    char magic[8];          // TRACE_MAGIC
+    uint32_t version;       // TRACE_VERSION
+    uint32_t record_size;   // sizeof(TraceRecord)
+    uint64_t record_count;  // filled in when the trace is closed
+    uint64_t reserved;
+};
+
+/**
+ * One state transition, holding every value the verbose line of that transition prints
+ */
+struct TraceRecord {
+    int32_t time;           // current time
+    int32_t pid;
+    int32_t duration;       // time spent in the previous state
+    int32_t burst;          // cb for RUN/PREEMPT, ib for BLOCK
+    int32_t remaining;      // remaining cpu time
+    int32_t priority;       // dynamic priority
+    uint8_t transition;     // Transitions
+    uint8_t from;           // Proc_State left by the process
+    uint16_t reserved;
+    uint32_t reserved2;
+};
+
+const char TRACE_MAGIC[8] = {'S', 'C', 'H', 'E', 'D', 'T', 'R', 'C'};
+const uint32_t TRACE_VERSION = 1;
+
+static_assert(sizeof(TraceHeader) == 32, "TraceHeader must be 32 bytes");
+static_assert(sizeof(TraceRecord) == 32, "TraceRecord must be 32 bytes");
+
+/**
+ * Writes trace records to a file without formatting or I/O on the simulation
+ * thread. Records go into a single-producer single-consumer ring that a
+ * background thread drains to the file. A full ring makes the producer wait,
+ * records are never dropped.
+ */
+class TraceWriter {
+private:
+    static const size_t CAPACITY = 1 << 16;    // records in the ring, power of two
+    vector<TraceRecord> ring;
+    atomic<size_t> head{0};                    // next record written by the simulation
+    atomic<size_t> tail{0};                    // next record drained to the file
+    atomic<bool> closing{false};
+    FILE *out = nullptr;
+    bool write_failed = false;
+    thread drainer;
+
+    /**
+     * Body of the background thread, writes the filled part of the ring until closed
+     */
+    void drain() {
+        while (true) {
+            size_t t = tail.load(memory_order_relaxed);
+            size_t h = head.load(memory_order_acquire);
+            if (t == h) {
+                if (closing.load(memory_order_acquire) && h == head.load(memory_order_acquire))
+                    break;
+                this_thread::sleep_for(chrono::microseconds(200));
+                continue;
+            }
+            /** at most two contiguous pieces when the filled part wraps around **/
+            while (t != h) {
+                size_t first = t & (CAPACITY - 1);
+                size_t n = min(h - t, CAPACITY - first);
+                if (fwrite(&ring[first], sizeof(TraceRecord), n, out) != n)
+                    write_failed = true;
+                t += n;
+            }
+            tail.store(t, memory_order_release);
+        }
+    }
+
+public:
+    TraceWriter() = default;
+
+    TraceWriter(const TraceWriter &) = delete;
+
+    TraceWriter &operator=(const TraceWriter &) = delete;
+
+    ~TraceWriter() {
+        close();
+    }
+
+    /**
+     * Create the trace file and start the background thread
+     * @param - filename - trace file
+     *
+     * @returns - false if the file cannot be created
+     */
+    bool open(const char *filename) {
+        out = fopen(filename, "wb");
+        if (out == nullptr) {
+            return false;
+        }
+        setvbuf(out, nullptr, _IOFBF, 1 << 20);
+        TraceHeader header{};
+        fwrite(&header, sizeof(header), 1, out); // placeholder, rewritten by close
+        ring.resize(CAPACITY);
+        drainer = thread(&TraceWriter::drain, this);
+        return true;
+    }
+
+    /**
+     * Append a record, waiting for the background thread when the ring is full
+     * @param - r - the record
+     */
+    void record(const TraceRecord &r) {
+        size_t h = head.load(memory_order_relaxed);
+        while (h - tail.load(memory_order_acquire) == CAPACITY)
+            this_thread::yield();
+        ring[h & (CAPACITY - 1)] = r;
+        head.store(h + 1, memory_order_release);
+    }
+
+    /**
+     * Drain the remaining records, stop the background thread and finish the header
+     *
+     * @returns - false if any write failed
+     */
+    bool close() {
+        if (out == nullptr) {
+            return true;
+        }
+        closing.store(true, memory_order_release);
+        drainer.join();
+
+        TraceHeader header{};
+        memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+        header.version = TRACE_VERSION;
+        header.record_size = sizeof(TraceRecord);
+        header.record_count = head.load();
+        bool ok = !write_failed && fseek(out, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, out) == 1;
+        ok = fclose(out) == 0 && ok;
+        out = nullptr;
+        return ok;
+    }
+};
+
+#ifndef SCHEDULER_LIBRARY
+/**
+ * Print a binary event trace in the format of -v
+ * @param - filename - trace file written by -e
+ */
+void decode_trace(const char *filename) {
+    MappedFile file;
+    TraceHeader header{};
+    if (!file.open(filename) || (size_t) (file.end() - file.begin()) < sizeof(header)) {
+        throw_error("Not a valid trace file <%s>", filename);
+    }
+    memcpy(&header, file.begin(), sizeof(header));
+    size_t size = file.end() - file.begin();
+    if (memcmp(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 || header.version != TRACE_VERSION ||
+        header.record_size != sizeof(TraceRecord) ||
+        (size - sizeof(header)) / sizeof(TraceRecord) < header.record_count) {
+        throw_error("Not a valid trace file <%s>", filename);
+    }
+
+    const auto *records = reinterpret_cast<const TraceRecord *>(file.begin() + sizeof(header));
+    for (uint64_t i = 0; i < header.record_count; i++) {
+        const TraceRecord &r = records[i];
+        switch (r.transition) {
+            case TRANS_TO_READY:
+                printf("%d %d %d: %s -> %s\n", r.time, r.pid, r.duration,
+                       STATE_STRING[r.from], STATE_STRING[READY]);
+                break;
+            case TRANS_TO_PREEMPT:
+                printf("%d %d %d: %s -> %s  cb=%d rem=%d prio=%d\n", r.time, r.pid, r.duration,
+                       STATE_STRING[r.from], STATE_STRING[READY], r.burst, r.remaining, r.priority);
+                break;
+            case TRANS_TO_RUN:
+                printf("%d %d %d: %s -> %s cb=%d rem=%d prio=%d\n", r.time, r.pid, r.duration,
+                       STATE_STRING[r.from], STATE_STRING[RUNNING], r.burst, r.remaining, r.priority);
+                break;
+            case TRANS_TO_BLOCK:
+                printf("%d %d %d: %s -> %s  ib=%d rem=%d\n", r.time, r.pid, r.duration,
+                       STATE_STRING[r.from], STATE_STRING[BLOCKED], r.burst, r.remaining);
+                break;
+            case TRANS_TO_DONE:
+                printf("%d %d %d: Done\n", r.time, r.pid, r.duration);
+                break;
+            default:
+                throw_error("Not a valid trace record %llu in <%s>", (unsigned long long) i, filename);
+        }
+    }
+}
+#endif
+
+/**
+ * All mutable state of one simulation run. Several contexts can run at the
+ * same time on different threads as long as they share only the Workload.
+ */
+class SimulationContext {
+private:
+    const Workload *workload;
+    unsigned long long ofs = 0;                // line offset for the random file
+    ProcessTable processes;                    // every process of the workload, indexed by pid
+    int current_time = 0;                      // current CPU time
+    int blocked_process_count = 0;             // total number of blocked process at a particular time
+    int time_io_busy = 0;                      // time at least one process is performing IO
+    int io_busy_start_time = 0;                // time the current stretch of IO activity started
+    bool call_scheduler = false;               // flag to call the next process in the scheduler
+    Scheduler *scheduler;                      // Scheduler instance of the first CPU
+    bool may_preempt = true;                   // scheduler->may_preempt(), read once per scheduler build
+    vector<CPU> cpus;                          // simulated CPUs, cpus[0] uses scheduler
+    vector<IODevice> devices;                  // -D: IO devices, empty when IO is infinitely parallel
+    int next_rebalance = 0;                    // time of the next rebalancing pass
+    DES_Layer *dispatcher;                     // DES Layer being used in the simulation
+    unsigned long sim_heap_allocations = 0;    // operator new calls made by the event loop of run
+    TraceWriter *trace = nullptr;              // receives every transition when -e is given
+    ArrivalCursor *arrivals = nullptr;         // streamed arrivals, nullptr when every process is created up front
+    int next_pid = 0;                          // pid of the next streamed arrival
+    unsigned long long retired_count = 0;      // finished streamed processes, summed up and released
+    long long retired_turnaround = 0;
+    long long retired_io = 0;
+    long long retired_cpu_wait = 0;
+    SimulationOptions options;                 // settings the simulation was built with
+    const char *sched_spec;                    // options.scheduler, the schedulers were built from it
+    int num_cpus;                              // options.cpus
+    Balance_Policy balance_policy;             // options.balance, parsed
+    int rebalance_interval;
+    LatencyStats latency;                      // distributions over the finished processes
+    unsigned long long processed_events = 0;   // events taken by the loop, drives options.checkpoint_every
+    unsigned long long last_checkpoint = 0;    // processed_events at the last checkpoint or restore
+    vector<Event> batch;                       // events of the current timestamp, taken by next_batch
+    vector<unsigned long long> replay_cursor;  // -r: recorded burst pairs used, indexed by process slot
+    bool instrumented = false;                 // options.sched_stats, collect the -t counters
+    unsigned long long transition_counts[5] = {}; // -t: events processed, indexed by Transitions
+    unsigned long long preemptions = 0;        // -t: positive test_preempt results
+    unsigned long long run_ticks = 0;          // -t: cycle_count and wall time spent in run
+    double run_ns = 0;
+    Xoshiro256 prng;                           // -x: the built-in stream, used instead of randvals
+    Xoshiro256 priority_prng;                  // -x: the priority draws of that stream, in pid order
+
+    /**
+     * Get random number from randvals, or from the built-in stream
+     * @param - burst - the corresponding CPU or IO burst
+     *
+     * @returns - random value in the range of 1,..,burst
+     */
+    int get_random(int burst) {
+        if (options.prng) {
+            return 1 + (int) prng.bounded((uint32_t) burst);
+        }
+        int offset = (int) (ofs % workload->rand_count);
+        int random = 1 + (workload->randvals[offset] % burst);
+        ofs++;
+        return random;
+    }
+
+    /**
+     * Static priority of a new process. The built-in stream draws priorities
+     * from lanes of their own in pid order, so they do not depend on whether
+     * processes are created up front or as they arrive.
+     */
+    int initial_priority(int pid) {
+        if (options.prng) {
+            return 1 + (int) priority_prng.bounded(scheduler->get_maxprio());
+        }
+        if (arrivals) {
+            return 1 + workload->randvals[pid % workload->rand_count] % scheduler->get_maxprio();
+        }
+        return get_random(scheduler->get_maxprio());
+    }
+
+    /**
+     * Length of the CPU burst a process starts, recorded or drawn from the random file
+     */
+    int next_cpu_burst(Process *proc) {
+        if (!workload->replay) {
+            return get_random(proc->cpu_burst);
+        }
+        return workload->replay->next(proc->get_pid(), replay_cursor[proc->get_slot()]).cpu;
+    }
+
+    /**
+     * Length of the IO burst of a blocking process, which moves its replay cursor to the next pair
+     */
+    int next_io_burst(Process *proc) {
+        if (!workload->replay) {
+            return get_random(proc->io_burst);
+        }
+        return workload->replay->next(proc->get_pid(), replay_cursor[proc->get_slot()]++).io;
+    }
+
+    /**
+     * Create the next streamed process and its arrival event. The event is
+     * handed straight to the loop: streamed arrivals come sorted, and an
+     * arrival always goes before the dynamic events of its time, just like
+     * the arrival events put first by DES_Layer::initialize.
+     */
+    Event admit_next() {
+        ProcessSpec spec = arrivals->next();
+        int pid = next_pid++;
+        Process *p = processes.admit(pid, spec);
+        if (workload->replay) {
+            if (p->get_slot() >= (int) replay_cursor.size())
+                replay_cursor.resize(p->get_slot() + 1);
+            replay_cursor[p->get_slot()] = 0;
+        }
+        /** the same static priority the process gets when created up front **/
+        p->static_priority = initial_priority(pid);
+        p->dynamic_priority = p->static_priority - 1;
+
+        return {p->get_slot(), spec.arrival_time, TRANS_TO_READY, 0};
+    }
+
+    /**
+     * Fill batch with every event due at the time of the next one, merging
+     * streamed arrivals with the event queue: the arrivals of a time go
+     * before its queued events. Between two batches all state sits in the
+     * queues and tables, so this is also where checkpoints are taken.
+     *
+     * @returns - the time of the batch, -1 when the simulation is over
+     */
+    int next_batch() {
+        if (options.checkpoint_every && processed_events - last_checkpoint >= options.checkpoint_every) {
+            write_checkpoint();
+        }
+        batch.clear();
+        int t = dispatcher->get_next_event_time();
+        if (arrivals && arrivals->has_next() && (t < 0 || arrivals->peek_time() <= t)) {
+            t = arrivals->peek_time();
+            do {
+                batch.push_back(admit_next());
+            } while (arrivals->has_next() && arrivals->peek_time() == t);
+        }
+        if (t < 0) {
+            return t;
+        }
+        dispatcher->get_events_at(t, batch);
+        processed_events += batch.size();
+        return t;
+    }
+
+    /**
+     * Settings a checkpoint only fits, written first and compared on restore
+     */
+    void put_config(SnapshotWriter &out) {
+        out.put(CHECKPOINT_MAGIC);
+        out.put(CHECKPOINT_VERSION);
+        out.put_string(sched_spec);
+        out.put(num_cpus);
+        out.put<int32_t>(balance_policy);
+        out.put(rebalance_interval);
+        out.put<uint8_t>(arrivals != nullptr);
+        out.put<uint64_t>(arrivals ? arrivals->size() : workload->process_count);
+        out.put<uint64_t>(workload->rand_count);
+        out.put_string(options.io_devices);
+        out.put<uint64_t>(workload->replay ? workload->replay->pair_count : 0);
+        out.put<uint8_t>(options.prng);
+        out.put(options.seed);
+    }
+
+    /**
+     * Write the whole simulation state to options.checkpoint_file, through a
+     * temporary file that is renamed into place so a crash while writing
+     * leaves the previous checkpoint intact
+     */
+    void write_checkpoint() {
+        const char *filename = options.checkpoint_file.c_str();
+        string tmp = options.checkpoint_file + ".tmp";
+        FILE *f = fopen(tmp.c_str(), "wb");
+        if (f == nullptr) {
+            throw_error("Cannot write checkpoint <%s>", filename);
+        }
+        setvbuf(f, nullptr, _IOFBF, 1 << 20);
+        SnapshotWriter out(f);
+        put_config(out);
+
+        out.put_table(processes);
+        out.put(ofs);
+        out.put(prng);
+        out.put(priority_prng);
+        out.put(current_time);
+        out.put(blocked_process_count);
+        out.put(time_io_busy);
+        out.put(io_busy_start_time);
+        out.put(call_scheduler);
+        out.put(next_rebalance);
+        out.put(next_pid);
+        out.put(retired_count);
+        out.put(retired_turnaround);
+        out.put(retired_io);
+        out.put(retired_cpu_wait);
+        out.put(processed_events);
+        out.put(transition_counts);
+        out.put(preemptions);
+        out.put(latency);
+        dispatcher->save(out);
+        for (CPU &cpu: cpus) {
+            out.put_process(cpu.running);
+            out.put(cpu.queued);
+            out.put(cpu.busy_time);
+            out.put(cpu.dispatches);
+            out.put(cpu.migrations);
+            out.put(cpu.steals);
+            out.put(cpu.queue_histogram);
+            /** CPUs sharing the global run queue save it once **/
+            if (cpu.id == 0 || balance_policy != GLOBAL_QUEUE)
+                cpu.scheduler->save(out);
+        }
+        for (IODevice &device: devices)
+            device.save(out);
+        out.put<uint64_t>(replay_cursor.size());
+        for (unsigned long long cursor: replay_cursor)
+            out.put(cursor);
+
+        bool ok = out.good();
+        ok = fclose(f) == 0 && ok;
+        if (!ok || rename(tmp.c_str(), filename) != 0) {
+            remove(tmp.c_str());
+            throw_error("Cannot write checkpoint <%s>", filename);
+        }
+        last_checkpoint = processed_events;
+    }
+
+    /**
+     * Time of the next event, including streamed arrivals, -1 if there is none
+     */
+    int next_event_time() {
+        int t = dispatcher->get_next_event_time();
+        if (arrivals && arrivals->has_next() && (t < 0 || arrivals->peek_time() < t))
+            t = arrivals->peek_time();
+        return t;
+    }
+
+    /**
+     * Fold a finished streamed process into the summary and free its slot
+     */
+    void retire(Process *proc) {
+        int slot = proc->get_slot();
+        retired_count++;
+        retired_turnaround += processes.finishing_time[slot] - processes.arrival_time[slot];
+        retired_io += processes.io_time[slot];
+        retired_cpu_wait += processes.cpu_wait_time[slot];
+        processes.release(proc);
+    }
+
+    /**
+     * Record a transition in the event trace, with the values its verbose line prints
+     * @param - transition - the transition being processed
+     * @param - proc - the process, still in the state it leaves
+     * @param - duration - time spent in that state
+     * @param - burst - cb or ib printed with the transition
+     */
+    void trace_transition(Transitions transition, Process *proc, int duration, int burst) {
+        TraceRecord r{};
+        r.time = current_time;
+        r.pid = proc->get_pid();
+        r.duration = duration;
+        r.burst = burst;
+        r.remaining = proc->remaining_cpu_time;
+        r.priority = proc->dynamic_priority;
+        r.transition = (uint8_t) transition;
+        r.from = (uint8_t) proc->state;
+        trace->record(r);
+    }
+
+    /**
+     * Index of the CPU whose run queue backs a CPU
+     * @param - cpu - CPU index
+     */
+    [[nodiscard]] int run_queue_of(int cpu) const {
+        return balance_policy == GLOBAL_QUEUE ? 0 : cpu;
+    }
+
+    /**
+     * Device serving the IO of a process
+     */
+    IODevice &device_of(Process *proc) {
+        return devices[proc->get_pid() % devices.size()];
+    }
+
+    /**
+     * Create the event that ends the IO of a blocked process
+     * @param - proc - the blocked process
+     * @param - service - time until its IO completes
+     */
+    void put_io_done(Process *proc, int service) {
+        dispatcher->put_event(proc, current_time + service, TRANS_TO_READY);
+    }
+
+    /**
+     * Pick the run queue a ready process joins: the CPU it last ran on, or the
+     * least loaded CPU for a process that has not run yet
+     * @param - proc - the ready process
+     */
+    int select_run_queue(Process *proc) {
+        if (balance_policy == GLOBAL_QUEUE) {
+            return 0;
+        }
+        if (proc->cpu >= 0) {
+            return proc->cpu;
+        }
+        int best = 0;
+        for (int c = 1; c < num_cpus; c++) {
+            int load = cpus[c].queued + (cpus[c].running != nullptr);
+            int best_load = cpus[best].queued + (cpus[best].running != nullptr);
+            if (load < best_load)
+                best = c;
+        }
+        return best;
+    }
+
+    /**
+     * Add a ready process to a run queue, first preempting a process running
+     * on a CPU fed by that queue if the scheduler asks for it
+     * @param - proc - the ready process
+     */
+    void add_ready_process(Process *proc) {
+        int q = select_run_queue(proc);
+        Scheduler *s = cpus[q].scheduler;
+
+        /** new process ready, preempt the current running process, F, L, S, R and P never do **/
+        if (may_preempt) {
+            for (CPU &cpu: cpus) {
+                if (run_queue_of(cpu.id) != q) {
+                    continue;
+                }
+                if (s->test_preempt(proc, cpu.running, dispatcher, current_time)) {
+                    if (instrumented)
+                        preemptions++;
+                    // remove the later events
+                    dispatcher->remove_events(cpu.running, current_time);
+
+                    // preempt the current running process
+                    Process *p = cpu.running;
+                    dispatcher->put_event(p, current_time, TRANS_TO_PREEMPT);
+                    break;
+                }
+            }
+        }
+
+        /** the run queue insert waits for the end of the batch, the count is used right away **/
+        cpus[q].ready_batch.push_back(proc);
+        cpus[q].queued++;
+    }
+
+    /**
+     * Insert the processes that became ready during a batch into their run queues
+     */
+    void flush_ready_batches() {
+        for (CPU &cpu: cpus) {
+            if (cpu.ready_batch.empty())
+                continue;
+            cpu.scheduler->add_processes(cpu.ready_batch.data(), cpu.ready_batch.size());
+            cpu.ready_batch.clear();
+        }
+    }
+
+    /**
+     * Take the next process for an idle CPU from its run queue, stealing from
+     * the longest run queue when its own is empty under WORK_STEALING
+     * @param - cpu - the idle CPU
+     */
+    Process *take_next_process(CPU &cpu) {
+        int q = run_queue_of(cpu.id);
+        if (cpus[q].queued == 0 && balance_policy == WORK_STEALING) {
+            int victim = -1;
+            for (int c = 0; c < num_cpus; c++) {
+                if (cpus[c].queued > 0 && (victim < 0 || cpus[c].queued > cpus[victim].queued))
+                    victim = c;
+            }
+            if (victim < 0) {
+                return nullptr;
+            }
+            q = victim;
+            cpu.steals++;
+        }
+
+        Process *p = cpus[q].scheduler->get_next_process();
+        if (p) {
+            cpus[q].queued--;
+        }
+        return p;
+    }
+
+    /**
+     * Move processes from the longest to the shortest run queues until their lengths differ by at most one
+     */
+    void rebalance_run_queues() {
+        while (true) {
+            int longest = 0, shortest = 0;
+            for (int c = 1; c < num_cpus; c++) {
+                if (cpus[c].queued > cpus[longest].queued)
+                    longest = c;
+                if (cpus[c].queued < cpus[shortest].queued)
+                    shortest = c;
+            }
+            if (cpus[longest].queued - cpus[shortest].queued <= 1) {
+                break;
+            }
+            Process *p = cpus[longest].scheduler->get_next_process();
+            cpus[longest].queued--;
+            cpus[shortest].scheduler->add_process(p);
+            cpus[shortest].queued++;
+        }
+        while (next_rebalance <= current_time)
+            next_rebalance += rebalance_interval;
+    }
+
+    /**
+     * One scheduler instance per CPU, the first one is scheduler; CPUs
+     * sharing the global run queue share its instance
+     */
+    void create_schedulers() {
+        scheduler = getScheduler(sched_spec);
+        may_preempt = scheduler->may_preempt();
+        for (int c = 0; c < num_cpus; c++) {
+            Scheduler *s = scheduler;
+            if (c > 0 && balance_policy != GLOBAL_QUEUE)
+                s = getScheduler(sched_spec);
+            if (c < (int) cpus.size())
+                cpus[c].scheduler = s;
+            else
+                cpus.emplace_back(c, s);
+        }
+    }
+
+    void delete_schedulers() {
+        for (CPU &cpu: cpus)
+            if (cpu.scheduler != scheduler)
+                delete cpu.scheduler;
+        delete scheduler;
+    }
+
+    /**
+     * Create the processes with their priorities, or put them back into that
+     * state when the table is filled already
+     */
+    void create_processes() {
+        if (options.prng) {
+            prng.seed(options.seed, options.random_offset);
+            priority_prng.seed(options.seed, options.random_offset, true);
+        }
+        if (arrivals) {
+            /** admit_next hands out the priorities the up-front path draws here **/
+            ofs = arrivals->size();
+            return;
+        }
+        ofs = options.random_offset;
+        if (processes.size() == 0) {
+            processes.reserve(workload->process_count);
+            for (size_t i = 0; i < workload->process_count; i++)
+                processes.add(workload->processes[i]);
+        } else {
+            processes.reinitialize(workload->processes);
+        }
+        for (size_t i = 0; i < workload->process_count; i++) {
+            Process *p = processes.get((int) i);
+            /** Initialize the static and dynamic priorities **/
+            p->static_priority = initial_priority((int) i);
+            p->dynamic_priority = p->static_priority - 1;
+        }
+    }
+
+public:
+    /**
+     * Build the processes, CPUs and event queue of a simulation
+     * @param - w - parsed input shared with other simulations
+     * @param - opts - scheduler, event queue, CPUs, balancing, IO devices and random offset
+     * @param - stream - if given, processes are created as they arrive instead of from w
+     */
+    SimulationContext(const Workload *w, const SimulationOptions &opts, ArrivalCursor *stream = nullptr) {
+        workload = w;
+        arrivals = stream;
+        options = opts;
+        sched_spec = options.scheduler.c_str();
+        instrumented = options.sched_stats;
+        num_cpus = options.cpus;
+        if (num_cpus <= 0) {
+            throw_error("Invalid number of CPUs <%d>", num_cpus);
+        }
+        get_balance_policy(options.balance.c_str(), balance_policy, rebalance_interval);
+        next_rebalance = rebalance_interval;
+        if (!options.io_devices.empty())
+            get_io_devices(options.io_devices.c_str(), devices);
+
+        /** a bad event queue or sched spec throws before the other one is built **/
+        dispatcher = new DES_Layer(getEventQueue(options.event_queue.c_str()));
+        try {
+            create_schedulers();
+        } catch (...) {
+            delete dispatcher;
+            throw;
+        }
+        create_processes();
+        if (workload->replay)
+            replay_cursor.resize(processes.size());
+
+        dispatcher->instrument(instrumented);
+        dispatcher->initialize(processes);
+    }
+
+    /**
+     * True if reset can take a simulation to these options: the CPUs, run
+     * queue layout, event queue and IO devices stay, the rest may change
+     */
+    [[nodiscard]] bool same_shape(const SimulationOptions &opts) const {
+        return arrivals == nullptr && opts.cpus == options.cpus && opts.balance == options.balance &&
+               opts.event_queue == options.event_queue && opts.io_devices == options.io_devices;
+    }
+
+    /**
+     * Take the simulation back to its start for another run, keeping the
+     * process table, event queue, run queues and IO queues with their
+     * capacity. The schedulers are only built anew for a different spec.
+     * @param - opts - options of the next run, same_shape must hold
+     */
+    void reset(const SimulationOptions &opts) {
+        bool same_scheduler = opts.scheduler == options.scheduler;
+        if (!same_scheduler) {
+            /** throws on a bad spec while the simulation is still intact **/
+            delete getScheduler(opts.scheduler.c_str());
+        }
+        options = opts;
+        sched_spec = options.scheduler.c_str();
+        instrumented = options.sched_stats;
+        dispatcher->instrument(instrumented);
+        if (same_scheduler) {
+            for (CPU &cpu: cpus)
+                if (cpu.id == 0 || balance_policy != GLOBAL_QUEUE)
+                    cpu.scheduler->clear();
+        } else {
+            delete_schedulers();
+            create_schedulers();
+        }
+        for (CPU &cpu: cpus) {
+            cpu.running = nullptr;
+            cpu.queued = cpu.busy_time = cpu.dispatches = cpu.migrations = cpu.steals = 0;
+            fill(begin(cpu.queue_histogram), end(cpu.queue_histogram), 0);
+            cpu.ready_batch.clear();
+        }
+        for (IODevice &device: devices)
+            device.clear();
+
+        current_time = 0;
+        blocked_process_count = 0;
+        time_io_busy = io_busy_start_time = 0;
+        call_scheduler = false;
+        next_rebalance = rebalance_interval;
+        latency = LatencyStats();
+        processed_events = last_checkpoint = 0;
+        fill(begin(transition_counts), end(transition_counts), 0);
+        preemptions = run_ticks = 0;
+        run_ns = 0;
+        batch.clear();
+        fill(replay_cursor.begin(), replay_cursor.end(), 0);
+        create_processes();
+
+        dispatcher->clear();
+        dispatcher->initialize(processes);
+    }
+
+    SimulationContext(const SimulationContext &) = delete;
+
+    SimulationContext &operator=(const SimulationContext &) = delete;
+
+    /**
+     * Continue from a checkpoint written by an earlier run with the same
+     * workload and settings, the rest of the run then matches that run
+     * @param - filename - checkpoint file
+     */
+    void restore(const char *filename) {
+        SnapshotReader in;
+        if (!in.open(filename, &processes)) {
+            throw_error("Not a valid checkpoint <%s>", filename);
+        }
+
+        /** compare the settings field by field with what this run would write **/
+        char magic[8];
+        in.get(magic);
+        bool same = memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) == 0 &&
+                    in.get<uint32_t>() == CHECKPOINT_VERSION &&
+                    in.get_string() == sched_spec &&
+                    in.get<int>() == num_cpus &&
+                    in.get<int32_t>() == balance_policy &&
+                    in.get<int>() == rebalance_interval &&
+                    in.get<uint8_t>() == (arrivals != nullptr) &&
+                    in.get<uint64_t>() == (arrivals ? arrivals->size() : workload->process_count) &&
+                    in.get<uint64_t>() == workload->rand_count &&
+                    in.get_string() == options.io_devices &&
+                    in.get<uint64_t>() == (workload->replay ? workload->replay->pair_count : 0) &&
+                    in.get<uint8_t>() == options.prng &&
+                    in.get<unsigned long long>() == options.seed;
+        if (!same) {
+            throw_error("Checkpoint <%s> was written for a different workload or settings", filename);
+        }
+
+        in.get_table();
+        in.get(ofs);
+        in.get(prng);
+        in.get(priority_prng);
+        in.get(current_time);
+        in.get(blocked_process_count);
+        in.get(time_io_busy);
+        in.get(io_busy_start_time);
+        in.get(call_scheduler);
+        in.get(next_rebalance);
+        in.get(next_pid);
+        in.get(retired_count);
+        in.get(retired_turnaround);
+        in.get(retired_io);
+        in.get(retired_cpu_wait);
+        in.get(processed_events);
+        in.get(transition_counts);
+        in.get(preemptions);
+        in.get(latency);
+        dispatcher->restore(in);
+        for (CPU &cpu: cpus) {
+            cpu.running = in.get_process();
+            in.get(cpu.queued);
+            in.get(cpu.busy_time);
+            in.get(cpu.dispatches);
+            in.get(cpu.migrations);
+            in.get(cpu.steals);
+            in.get(cpu.queue_histogram);
+            if (cpu.id == 0 || balance_policy != GLOBAL_QUEUE)
+                cpu.scheduler->restore(in);
+        }
+        for (IODevice &device: devices)
+            device.restore(in);
+        replay_cursor.resize(in.get<uint64_t>());
+        for (unsigned long long &cursor: replay_cursor)
+            in.get(cursor);
+        if (!in.at_end()) {
+            throw_error("Not a valid checkpoint <%s>", filename);
+        }
+
+        /** streamed processes admitted before the checkpoint are in the table already **/
+        for (int pid = 0; arrivals && pid < next_pid; pid++)
+            arrivals->next();
+        last_checkpoint = processed_events;
+    }
+
+    /**
+     * Send every transition of the next run to a trace writer
+     * @param - writer - open trace writer, nullptr disables tracing
+     */
+    void set_trace(TraceWriter *writer) {
+        trace = writer;
+    }
+
+    /**
+     * Start simulation. Events are taken one timestamp at a time and applied
+     * in order; the processes they make ready reach the run queues in one
+     * bulk insert per batch, and the scheduler runs once no event is left at
+     * that time.
+     */
+    void run() {
+        unsigned long heap_allocations_at_start = HEAP_ALLOCATIONS;
+        COUNT_ALLOCATIONS = true;
+        auto start_time = chrono::steady_clock::now();
+        unsigned long long start_ticks = cycle_count();
+        int batch_time;
+        while ((batch_time = next_batch()) >= 0) {
+            current_time = batch_time;
+            for (const Event &evt: batch) {
+                Process *proc = processes.get(evt.slot); // this is the process the event works on
+                Transitions transition = evt.transition();
+                int timeInPrevState = current_time - proc->state_start_time; // for accounting
+                dispatcher->release_event(evt); // the process has no outstanding event from here on
+                if (instrumented)
+                    transition_counts[transition]++;
+
+                switch (transition) {
+                    case TRANS_TO_READY: {
+                        /** must come from BLOCKED or CREATED **/
+                        if (proc->state != BLOCKED && proc->state != CREATED && proc->state != RUNNING) {
+                            throw_error("TRANS_TO_READY - Incorrect incoming state - %s, expected BLOCKED/CREATED/RUNNING",
+                                   STATE_STRING[proc->state]);
+                        }
+
+                        if (options.verbose)
+                            printf("%d %d %d: %s -> %s\n",
+                                   current_time, proc->get_pid(), timeInPrevState,
+                                   STATE_STRING[proc->state], STATE_STRING[READY]);
+                        if (trace)
+                            trace_transition(TRANS_TO_READY, proc, timeInPrevState, 0);
+                        if (proc->state == BLOCKED) {
+                            /** perform accounting for BLOCKED to READY **/
+                            processes.io_time[proc->get_slot()] += timeInPrevState;
+                            blocked_process_count--;
+                            if (blocked_process_count == 0) {
+                                time_io_busy += current_time - io_busy_start_time;
+                                io_busy_start_time = 0;
+                            }
+                            if (!devices.empty()) {
+                                /** the freed channel goes to the next waiting request **/
+                                int service;
+                                Process *next = device_of(proc).complete(current_time, service);
+                                if (next)
+                                    put_io_done(next, service);
+                            }
+                            // reset dynamic priority
+                            proc->dynamic_priority = proc->static_priority - 1;
+                        }
+
+                        /** add process to run queue, no event created **/
+                        proc->state_start_time = current_time;
+                        proc->state = READY;
+
+                        add_ready_process(proc);
+                        call_scheduler = true;
+                        break;
+                    }
+                    case TRANS_TO_PREEMPT: // similar to TRANS_TO_READY
+                    {
+                        if (proc->state != RUNNING) {
+                            throw_error("TRANS_TO_PREEMPT - Incorrect incoming state - %s, expected RUNNING",
+                                   STATE_STRING[proc->state]);
+                        }
+                        /** perform accounting for RUNNING to PREEMPT **/
+                        proc->remaining_cpu_time -= timeInPrevState;
+                        proc->curr_cpu_burst -= timeInPrevState;
+                        cpus[proc->cpu].busy_time += timeInPrevState;
+
+                        /** must come from RUNNING (preemption) **/
+                        if (options.verbose)
+                            printf("%d %d %d: %s -> %s  cb=%d rem=%d prio=%d\n",
+                                   current_time, proc->get_pid(), timeInPrevState,
+                                   STATE_STRING[proc->state], STATE_STRING[READY],
+                                   proc->curr_cpu_burst, proc->remaining_cpu_time, proc->dynamic_priority);
+                        if (trace)
+                            trace_transition(TRANS_TO_PREEMPT, proc, timeInPrevState, proc->curr_cpu_burst);
+                        if (proc == cpus[proc->cpu].running) {
+                            cpus[proc->cpu].running = nullptr;
+                        }
+
+                        /** add process to run queue, no event created **/
+                        proc->dynamic_priority--;
+                        proc->state_start_time = current_time;
+                        proc->state = READY;
+
+                        add_ready_process(proc);
+                        call_scheduler = true;
+                        break;
+                    }
+                    case TRANS_TO_RUN: {
+                        if (proc->state != READY) {
+                            throw_error("TRANS_TO_RUN - Incorrect incoming state - %s, expected READY",
+                                   STATE_STRING[proc->state]);
+                        }
+                        /** perform accounting READY to RUNNING **/
+                        processes.cpu_wait_time[proc->get_slot()] += timeInPrevState;
+                        if (processes.response_time[proc->get_slot()] < 0)
+                            processes.response_time[proc->get_slot()] = current_time - processes.arrival_time[proc->get_slot()];
+
+                        /** calculations for new state **/
+                        if (proc->curr_cpu_burst == 0) {
+                            int cb = next_cpu_burst(proc);
+                            if (proc->remaining_cpu_time < cb)
+                                cb = proc->remaining_cpu_time;
+                            proc->curr_cpu_burst = cb;
+                        }
+                        cpus[proc->cpu].running = proc;
+
+                        /** create event for either preemption or blocking */
+                        int slice = cpus[run_queue_of(proc->cpu)].scheduler->time_slice(proc);
+                        if (slice < proc->curr_cpu_burst) {
+                            /** create event for preemption **/
+                            dispatcher->put_event(proc, current_time + slice, TRANS_TO_PREEMPT);
+                        } else if (proc->curr_cpu_burst == proc->remaining_cpu_time) {
+                            /** create event for done **/
+                            dispatcher->put_event(proc, current_time + proc->curr_cpu_burst, TRANS_TO_DONE);
+                        } else {
+                            /** create event for blocking **/
+                            dispatcher->put_event(proc, current_time + proc->curr_cpu_burst, TRANS_TO_BLOCK);
+                        }
+
+                        if (options.verbose)
+                            printf("%d %d %d: %s -> %s cb=%d rem=%d prio=%d\n",
+                                   current_time, proc->get_pid(), timeInPrevState,
+                                   STATE_STRING[proc->state], STATE_STRING[RUNNING],
+                                   proc->curr_cpu_burst, proc->remaining_cpu_time, proc->dynamic_priority);
+                        if (trace)
+                            trace_transition(TRANS_TO_RUN, proc, timeInPrevState, proc->curr_cpu_burst);
+
+                        proc->state_start_time = current_time;
+                        proc->state = RUNNING;
+
+                        call_scheduler = true;
+                        break;
+                    }
+                    case TRANS_TO_BLOCK: {
+                        if (proc->state != RUNNING) {
+                            throw_error("TRANS_TO_BLOCK - Incorrect incoming state - %s, expected RUNNING",
+                                   STATE_STRING[proc->state]);
+                        }
+
+                        /** perform accounting RUNNING to BLOCK **/
+                        proc->remaining_cpu_time -= timeInPrevState;
+                        proc->curr_cpu_burst = 0;
+                        cpus[proc->cpu].busy_time += timeInPrevState;
+                        cpus[proc->cpu].running = nullptr;
+
+                        /** calculations for new state **/
+                        int ib = next_io_burst(proc);
+                        blocked_process_count++;
+                        if (blocked_process_count == 1) {
+                            io_busy_start_time = current_time;
+                        }
+
+                        /** create an event for when process becomes READY again, unless its device is busy **/
+                        if (devices.empty() || device_of(proc).submit(proc, ib, current_time))
+                            put_io_done(proc, ib);
+
+                        if (options.verbose)
+                            printf("%d %d %d: %s -> %s  ib=%d rem=%d\n",
+                                   current_time, proc->get_pid(), timeInPrevState,
+                                   STATE_STRING[proc->state], STATE_STRING[BLOCKED],
+                                   ib, proc->remaining_cpu_time);
+                        if (trace)
+                            trace_transition(TRANS_TO_BLOCK, proc, timeInPrevState, ib);
+
+                        proc->state_start_time = current_time;
+                        proc->state = BLOCKED;
+
+                        call_scheduler = true;
+                        break;
+                    }
+                    case TRANS_TO_DONE: {
+                        if (proc->state != RUNNING) {
+                            throw_error("TRANS_TO_DONE - Incorrect incoming state - %s, expected RUNNING",
+                                   STATE_STRING[proc->state]);
+                        }
+
+                        /** perform accounting RUNNING to DONE **/
+                        int slot = proc->get_slot();
+                        processes.finishing_time[slot] = current_time;
+                        latency.turnaround.add(current_time - processes.arrival_time[slot]);
+                        latency.ready_wait.add(processes.cpu_wait_time[slot]);
+                        latency.response.add(processes.response_time[slot]);
+                        cpus[proc->cpu].busy_time += timeInPrevState;
+                        cpus[proc->cpu].running = nullptr;
+
+                        if (options.verbose)
+                            printf("%d %d %d: Done\n", current_time, proc->get_pid(), timeInPrevState);
+                        if (trace)
+                            trace_transition(TRANS_TO_DONE, proc, timeInPrevState, 0);
+                        if (arrivals)
+                            retire(proc);
+                        call_scheduler = true;
+                        break;
+                    }
+                }
+            }
+            flush_ready_batches();
+
+            if (call_scheduler) {
+                if (dispatcher->has_more_at_batch_time())
+                    continue;           // events put at this time during the batch go first
+                call_scheduler = false; // reset flag
+                if (balance_policy == PERIODIC_REBALANCE && current_time >= next_rebalance) {
+                    rebalance_run_queues();
+                }
+                for (CPU &cpu: cpus) {
+                    if (cpu.running != nullptr) {
+                        continue;
+                    }
+                    if (instrumented) {
+                        unsigned queued = cpus[run_queue_of(cpu.id)].queued;
+                        cpu.queue_histogram[queued ? 32 - __builtin_clz(queued) : 0]++;
+                    }
+                    Process *next = take_next_process(cpu);
+                    if (next == nullptr)
+                        continue;
+                    if (next->cpu >= 0 && next->cpu != cpu.id) {
+                        cpu.migrations++;
+                    }
+                    next->cpu = cpu.id;
+                    cpu.running = next;
+                    cpu.dispatches++;
+
+                    /** create event to make this process runnable for same time **/
+                    dispatcher->put_event(next, current_time, TRANS_TO_RUN);
+                }
+            }
+        }
+        COUNT_ALLOCATIONS = false;
+        sim_heap_allocations = HEAP_ALLOCATIONS - heap_allocations_at_start;
+        run_ticks = cycle_count() - start_ticks;
+        run_ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start_time).count();
+    }
+
+public:
+
+    /**
+     * Compute the values of the SUM line
+     */
+    Summary summarize() {
+        size_t num_processes = retired_count;
+        int finish_time = current_time;
+        long long total_turnaround = retired_turnaround;
+        long long total_io = retired_io;
+        long long total_cpu_wait = retired_cpu_wait;
+
+        if (!arrivals) {
+            /** straight-line sums over the accounting arrays, vectorized by the compiler **/
+            num_processes = processes.size();
+            const int *finishing = processes.finishing_time.data();
+            const int *arrival = processes.arrival_time.data();
+            const int *io = processes.io_time.data();
+            const int *cpu_wait = processes.cpu_wait_time.data();
+            for (size_t i = 0; i < num_processes; i++) {
+                total_turnaround += finishing[i] - arrival[i];
+                total_io += io[i];
+                total_cpu_wait += cpu_wait[i];
+            }
+        }
+        long long time_cpu_busy = total_turnaround - total_io - total_cpu_wait;
+
+        Summary sum{};
+        sum.finish_time = finish_time;
+        sum.cpu_util = 100.0 * (time_cpu_busy / ((double) finish_time * num_cpus));
+        sum.io_util = 100.0 * (time_io_busy / (double) finish_time);
+        sum.avg_turnaround_time = (total_turnaround / (double) num_processes);
+        sum.avg_cpu_wait_time = (total_cpu_wait / (double) num_processes);
+        sum.throughput = 100.0 * (num_processes / (double) finish_time);
+        return sum;
+    }
+
+    /**
+     * Collect what the run reports. The per-process results are left out
+     * when arrivals are streamed, the processes are gone by then.
+     */
+    SimulationResults results() {
+        SimulationResults res;
+        res.scheduler = scheduler->to_string();
+        res.sum = summarize();
+        res.events = dispatcher->event_count();
+        res.event_bytes = dispatcher->memory_bytes();
+        res.heap_allocations = sim_heap_allocations;
+        res.turnaround = latency.turnaround.percentiles();
+        res.ready_wait = latency.ready_wait.percentiles();
+        res.response = latency.response.percentiles();
+
+        int finish_time = current_time;
+        for (CPU &cpu: cpus) {
+            res.cpus.push_back({100.0 * (cpu.busy_time / (double) finish_time), cpu.dispatches, cpu.migrations,
+                                cpu.steals});
+        }
+        for (IODevice &device: devices) {
+            res.io_devices.push_back({device.to_string(),
+                                      100.0 * (device.service_time / ((double) finish_time * device.concurrency)),
+                                      100.0 * (device.busy_time / (double) finish_time), device.requests,
+                                      device.delayed,
+                                      device.delayed ? device.wait_time / (double) device.delayed : 0.0,
+                                      device.max_wait, device.max_queue});
+        }
+
+        if (options.keep_latency)
+            res.latency = make_shared<LatencyStats>(latency);
+        for (int pid = 0; options.per_process && !arrivals && pid < (int) processes.size(); pid++) {
+            Process *p = processes.get(pid);
+            res.processes.push_back({pid, processes.arrival_time[pid], processes.total_cpu_time[pid], p->cpu_burst,
+                                     p->io_burst, p->static_priority, processes.finishing_time[pid],
+                                     processes.finishing_time[pid] - processes.arrival_time[pid],
+                                     processes.io_time[pid], processes.cpu_wait_time[pid]});
+        }
+        return res;
+    }
+
+    /**
+     * Print the -t counters: events per transition, event queue cost and
+     * depth, preemptions and the run queue length histogram of every CPU
+     */
+    void print_sched_stats() {
+        unsigned long long events = 0;
+        for (unsigned long long n: transition_counts)
+            events += n;
+        printf("STATS: events=%llu wall=%.3lf ms events/sec=%.0lf\n",
+               events, run_ns / 1e6, run_ns > 0 ? events / run_ns * 1e9 : 0.0);
+        printf("STATS: READY=%llu PREEMPT=%llu RUN=%llu BLOCK=%llu DONE=%llu preemptions=%llu\n",
+               transition_counts[TRANS_TO_READY], transition_counts[TRANS_TO_PREEMPT],
+               transition_counts[TRANS_TO_RUN], transition_counts[TRANS_TO_BLOCK],
+               transition_counts[TRANS_TO_DONE], preemptions);
+        dispatcher->print_stats(run_ticks ? run_ns / run_ticks : 0.0);
+        for (CPU &cpu: cpus) {
+            printf("STATS: RUNQ %02d", cpu.id);
+            for (int k = 0; k < 32; k++) {
+                if (cpu.queue_histogram[k] == 0)
+                    continue;
+                if (k < 2)
+                    printf(" %d:%llu", k, cpu.queue_histogram[k]);
+                else
+                    printf(" %u-%u:%llu", 1u << (k - 1), (1u << k) - 1, cpu.queue_histogram[k]);
+            }
+            printf("\n");
+        }
+    }
+
+    /**
+     * Deallocate memory used by the simulation
+     */
+    ~SimulationContext() {
+        delete_schedulers();
+        delete dispatcher;
+    }
+};
 
+#ifndef SCHEDULER_LIBRARY
 /**
- * Helper functions
+ * Print the scheduling output in the format expected for grading
  */
+void print_output(const SimulationResults &res) {
+    printf("%s\n", res.scheduler.c_str());
+    for (const ProcessResult &p: res.processes) {
+        printf("%04d: %4d %4d %4d %4d %1d | %5d %5d %5d %5d\n",
+               p.pid, p.arrival_time, p.total_cpu_time, p.cpu_burst, p.io_burst, p.static_priority,
+               p.finishing_time, p.turnaround_time, p.io_time, p.cpu_wait_time);
+    }
+    const Summary &sum = res.sum;
+    printf("SUM: %d %.2lf %.2lf %.2lf %.2lf %.3lf\n",
+           sum.finish_time, sum.cpu_util, sum.io_util, sum.avg_turnaround_time, sum.avg_cpu_wait_time,
+           sum.throughput);
+}
 
 /**
- * check if a char* string has a character
- * @param str - actual string
- * @param ch - character to be searched
+ * Print utilization, dispatch, migration and steal counts of every simulated CPU
  */
-bool hasChar(const char *str, char ch) {
-    while (*str != '\0') {
-        if (*str == ch) {
-            return true;
-        }
-        str++;
+void print_cpu_stats(const SimulationResults &res) {
+    int total_migrations = 0;
+    for (size_t c = 0; c < res.cpus.size(); c++) {
+        const CpuResult &cpu = res.cpus[c];
+        printf("CPU %02d: %.2lf %d %d %d\n", (int) c, cpu.util, cpu.dispatches, cpu.migrations, cpu.steals);
+        total_migrations += cpu.migrations;
     }
-    return false;
+    printf("MIGRATIONS: %d\n", total_migrations);
 }
 
 /**
- * Get random number from randvals
- * @param - burst - the corresponding CPU or IO burst
- *
- * @returns - random value in the range of 1,..,burst
+ * Print utilization and queue wait of every IO device. util is the
+ * share of channel time in use, busy the share of time with any request
+ * in service, wait the average over the requests that had to queue.
  */
-int get_random(int burst) {
-    int offset = OFS % RAND_COUNT;
-    int random = 1 + (RANDVALS[offset] % burst);
-    OFS++;
-    return random;
+void print_io_stats(const SimulationResults &res) {
+    for (size_t d = 0; d < res.io_devices.size(); d++) {
+        const IODeviceResult &device = res.io_devices[d];
+        printf("IO %02d %-6s util=%.2lf busy=%.2lf requests=%llu queued=%llu wait=%.2lf max_wait=%d max_queue=%d\n",
+               (int) d, device.spec.c_str(), device.util, device.busy, device.requests, device.queued,
+               device.avg_wait, device.max_wait, device.max_queue);
+    }
 }
 
 /**
- * Print error message for incorrect input arguments
- * @param - filename - executable file's name
+ * Options of the command line run of a sched spec
+ * @param - sched_spec - -s spec, or one configuration of the sweep
  */
-void print_usage(char *filename) {
-    printf("Usage: %s [-v] [-t] [-e] [-p] [-i] [-s sched] inputfile randomfile\n"
-           "-v enables verbose\n"
-           "-t enables scheduler details\n"
-           "-e enables event tracing\n"
-           "-p enables E scheduler preemption tracing\n"
-           "-i single steps event by event\n",
-           filename);
+SimulationOptions cli_options(const char *sched_spec) {
+    SimulationOptions options;
+    options.scheduler = sched_spec;
+    options.event_queue = EVENT_QUEUE_SPEC;
+    options.cpus = NUM_CPUS;
+    options.balance = BALANCE_SPEC;
+    if (IO_DEVICE_SPEC)
+        options.io_devices = IO_DEVICE_SPEC;
+    options.prng = USE_PRNG;
+    options.seed = PRNG_SEED;
+    options.stream_arrivals = STREAM_ARRIVALS;
+    options.verbose = VERBOSE;
+    options.sched_stats = SHOW_SCHED_DETAILS;
+    if (SHOW_EVENT_TRACE)
+        options.trace_file = TRACE_FILE;
+    options.checkpoint_every = CHECKPOINT_EVERY;
+    options.checkpoint_file = CHECKPOINT_FILE;
+    if (RESTORE_FILE)
+        options.restore_file = RESTORE_FILE;
+    return options;
 }
 
 /**
- * Get the appropriate scheduler based on the arguments
- * @param - args - string that needs to parsed to fetch the scheduler type
- *
- * @returns - the correct Scheduler based on the arguments
+ * Expand the numeric ranges of a sweep spec into single scheduler specs
+ * @param - spec - comma separated sched specs, any number may be a range a..b
+ * @param - configs - receives one sched spec per configuration, in order
  */
-Scheduler *getScheduler(char *args) {
-    switch (args[0]) {
-        case 'F':
-            return new FCFSScheduler();
-        case 'L':
-            return new LCFSScheduler();
-        case 'S':
-            return new SRTFScheduler();
-        case 'R': {
-            int quantum;
-            sscanf(args, "R%d", &quantum);
-            if (quantum <= 0) {
-                printf("Invalid scheduler param <%s>\n", args);
-                exit(1);
-            }
-            return new RRScheduler(quantum);
+void expand_sweep(const string &spec, vector<string> &configs) {
+    size_t start = 0;
+    while (start <= spec.size()) {
+        size_t comma = spec.find(',', start);
+        if (comma == string::npos)
+            comma = spec.size();
+        string item = spec.substr(start, comma - start);
+        start = comma + 1;
+        if (item.empty())
+            continue;
+
+        size_t dots = item.find("..");
+        if (dots == string::npos) {
+            configs.push_back(item);
+            continue;
         }
-        case 'P': {
-            int quantum = 0;
-            int maxprio = 0;
-            sscanf(args, "P%d:%d", &quantum, &maxprio);
-            if (quantum <= 0 || (hasChar(args, ':') && maxprio <= 0)) {
-                printf("Invalid scheduler param <%s>\n", args);
-                exit(1);
-            }
-            return new PriorityScheduler(quantum, maxprio);
+
+        /** split "<prefix><lo>..<hi><suffix>" and expand the suffix recursively **/
+        size_t lo_start = dots;
+        while (lo_start > 0 && isdigit(item[lo_start - 1]))
+            lo_start--;
+        size_t hi_end = dots + 2;
+        while (hi_end < item.size() && isdigit(item[hi_end]))
+            hi_end++;
+        if (lo_start == dots || hi_end == dots + 2) {
+            throw_error("Invalid sweep spec <%s>", item.c_str());
         }
-        case 'E': {
-            int quantum = 0;
-            int maxprio = 0;
-            sscanf(args, "E%d:%d", &quantum, &maxprio);
-            if (quantum <= 0 || (hasChar(args, ':') && maxprio <= 0)) {
-                printf("Invalid scheduler param <%s>\n", args);
-                exit(1);
-            }
-            return new PreemptivePriorityScheduler(quantum, maxprio);
+        int lo = stoi(item.substr(lo_start, dots - lo_start));
+        int hi = stoi(item.substr(dots + 2, hi_end - dots - 2));
+        for (int v = lo; v <= hi; v++) {
+            expand_sweep(item.substr(0, lo_start) + std::to_string(v) + item.substr(hi_end), configs);
         }
-        default:
-            printf("Unknown Scheduler spec: -v {FLSRPE}\n");
-            exit(1);
     }
 }
 
 /**
- * Parse the numbers from the random-number file
- * @param - filename - random-number file
+ * Run every configuration of the sweep spec on a pool of threads sharing
+ * one Workload, then print one SUM line per configuration in spec order
+ * @param - workload - parsed input and random-number files
  */
-void parse_randoms(char *filename) {
-    fstream rand_file;
-    rand_file.open(filename, ios::in);
-
-    if (!rand_file.is_open()) {
-        printf("Not a valid inputfile <%s>\n", filename);
-        exit(1);
+void run_sweep(const shared_ptr<const Workload> &workload) {
+    vector<string> configs;
+    expand_sweep(SWEEP_SPEC, configs);
+
+    /** reject bad specs before any thread starts **/
+    for (const string &config: configs)
+        delete getScheduler(config.c_str());
+
+    vector<SimulationResults> results(configs.size());
+    atomic<size_t> next_config(0);
+    exception_ptr error;
+    mutex error_lock;
+    auto worker = [&]() {
+        /** every configuration has the same shape, a thread's simulator resets its run for the next one **/
+        Simulator simulator(workload);
+        size_t i;
+        try {
+            while ((i = next_config.fetch_add(1)) < configs.size())
+                results[i] = simulator.run(cli_options(configs[i].c_str()));
+        } catch (...) {
+            lock_guard<mutex> guard(error_lock);
+            error = current_exception();
+        }
+    };
+
+    int num_threads = SWEEP_THREADS > 0 ? SWEEP_THREADS : (int) thread::hardware_concurrency();
+    num_threads = max(1, min(num_threads, (int) configs.size()));
+    vector<thread> pool;
+    for (int t = 0; t < num_threads; t++)
+        pool.emplace_back(worker);
+    for (thread &t: pool)
+        t.join();
+    if (error)
+        rethrow_exception(error);
+
+    for (size_t i = 0; i < configs.size(); i++) {
+        const Summary &sum = results[i].sum;
+        printf("%-12s SUM: %d %.2lf %.2lf %.2lf %.2lf %.3lf\n", configs[i].c_str(),
+               sum.finish_time, sum.cpu_util, sum.io_util, sum.avg_turnaround_time, sum.avg_cpu_wait_time,
+               sum.throughput);
+        if (SHOW_PERCENTILES) {
+            char prefix[32];
+            snprintf(prefix, sizeof(prefix), "%-12s ", configs[i].c_str());
+            print_percentiles(prefix, results[i].turnaround, results[i].ready_wait, results[i].response);
+        }
     }
+}
 
-    string line;
-    getline(rand_file, line);
-    RAND_COUNT = stoi(line);
-
-    for (int i = 0; i < RAND_COUNT; i++) {
-        getline(rand_file, line);
-        RANDVALS.push_back(stoi(line));
+/**
+ * Two-sided 95% quantile of Student's t distribution
+ * @param - df - degrees of freedom, at least 1
+ */
+double t_quantile_95(int df) {
+    static const double TABLE[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                   2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                   2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    if (df <= 30) {
+        return TABLE[df - 1];
     }
+    /** Cornish-Fisher expansion around the normal quantile to the second order, within 0.0001 beyond df 30 **/
+    double z = 1.959964, z3 = z * z * z, z5 = z3 * z * z;
+    return z + (z3 + z) / (4.0 * df) + (5 * z5 + 16 * z3 + 3 * z) / (96.0 * df * df);
 }
 
 /**
- * Parse the process information from the input file
- * @param - filename - input file
+ * Run independent replications of the -s configuration on a pool of
+ * threads, replication r drawing from stream r of the built-in generator
+ * seeded with the -x seed, 0 without it. Offsets into the random file would
+ * overlap as soon as a run draws more than rand_count / K values, and wrap
+ * around it, which correlates the replications and narrows the confidence
+ * interval; the streams do not overlap. Threads take the next replication
+ * when they finish one, as run times vary with the preemption rate. Prints
+ * every replication's SUM line in order, then the mean and the half width
+ * of the 95% confidence interval of each value.
+ * @param - workload - parsed input and random-number files
+ * @param - count - number of replications, at least 2
  */
-void load_processes(char *filename) {
-    fstream input_file;
-
-    input_file.open(filename, ios::in);
-
-    if (!input_file.is_open()) {
-        printf("Not a valid inputfile <%s>\n", filename);
-        exit(1);
+void run_replications(const shared_ptr<const Workload> &workload, int count) {
+    vector<SimulationResults> results(count);
+    atomic<int> next_replication(0);
+    exception_ptr error;
+    mutex error_lock;
+    auto worker = [&]() {
+        Simulator simulator(workload);
+        SimulationOptions options = cli_options(SCHEDULER_SPEC);
+        options.keep_latency = SHOW_PERCENTILES;
+        options.prng = true;
+        int r;
+        try {
+            while ((r = next_replication.fetch_add(1)) < count) {
+                options.random_offset = r; // the stream index with prng
+                results[r] = simulator.run(options);
+            }
+        } catch (...) {
+            lock_guard<mutex> guard(error_lock);
+            error = current_exception();
+        }
+    };
+
+    int num_threads = SWEEP_THREADS > 0 ? SWEEP_THREADS : (int) thread::hardware_concurrency();
+    num_threads = max(1, min(num_threads, count));
+    vector<thread> pool;
+    for (int t = 0; t < num_threads; t++)
+        pool.emplace_back(worker);
+    for (thread &t: pool)
+        t.join();
+    if (error)
+        rethrow_exception(error);
+
+    printf("%s\n", results[0].scheduler.c_str());
+
+    /** one row per replication, the columns of the SUM line **/
+    vector<array<double, 6>> values;
+    for (int r = 0; r < count; r++) {
+        const Summary &sum = results[r].sum;
+        printf("REP %03d stream=%-5d SUM: %d %.2lf %.2lf %.2lf %.2lf %.3lf\n", r, r,
+               sum.finish_time, sum.cpu_util, sum.io_util, sum.avg_turnaround_time, sum.avg_cpu_wait_time,
+               sum.throughput);
+        values.push_back({(double) sum.finish_time, sum.cpu_util, sum.io_util, sum.avg_turnaround_time,
+                          sum.avg_cpu_wait_time, sum.throughput});
     }
 
-    string line;
-    while (getline(input_file, line)) {
-        auto *p = new Process(line);
-        /** Initialize the static and dynamic priorities **/
-        p->static_priority = SCHEDULER ? get_random(SCHEDULER->get_maxprio()) : get_random(4);
-        p->dynamic_priority = p->static_priority - 1;
-        PROCESSES.push_back(p);
+    double mean[6], half_width[6];
+    double t = t_quantile_95(count - 1);
+    for (int k = 0; k < 6; k++) {
+        double total = 0;
+        for (const auto &v: values)
+            total += v[k];
+        mean[k] = total / count;
+        double squares = 0;
+        for (const auto &v: values)
+            squares += (v[k] - mean[k]) * (v[k] - mean[k]);
+        half_width[k] = t * sqrt(squares / (count - 1)) / sqrt((double) count);
+    }
+    printf("MEAN: %.2lf %.2lf %.2lf %.2lf %.2lf %.3lf\n", mean[0], mean[1], mean[2], mean[3], mean[4], mean[5]);
+    printf("CI95: %.2lf %.2lf %.2lf %.2lf %.2lf %.3lf\n", half_width[0], half_width[1], half_width[2],
+           half_width[3], half_width[4], half_width[5]);
+    if (SHOW_PERCENTILES) {
+        SimulationResults pooled;
+        pool_percentiles(results, pooled);
+        print_percentiles("", pooled.turnaround, pooled.ready_wait, pooled.response);
     }
 }
 
 /**
- * Start simulation
+ * Time the hot paths of the simulator: DES_Layer put/get for every event
+ * queue and add/get for every scheduler at the given queue depths, then
+ * the full event loop of every scheduler on the loaded workload
+ * @param - workload - workload of the full runs
+ * @param - depth_spec - comma separated queue depths
  */
-void run_simulation() {
-    int io_busy_start_time = 0;
-    Event *evt;
-    while ((evt = DISPATCHER->get_event())) {
-        Process *proc = evt->process; // this is the process the event works on
-        CURRENT_TIME = evt->timestamp;
-        Transitions transition = evt->transition;
-        int timeInPrevState = CURRENT_TIME - proc->state_start_time; // for accounting
-        delete evt; // delete cur event obj and don’t touch anymore
-
-        switch (transition) {
-            case TRANS_TO_READY: {
-                /** must come from BLOCKED or CREATED **/
-                if (proc->state != BLOCKED && proc->state != CREATED && proc->state != RUNNING) {
-                    printf("TRANS_TO_READY - Incorrect incoming state - %s, expected BLOCKED/CREATED/RUNNING\n",
-                           STATE_STRING[proc->state].c_str());
-                    exit(1);
-                }
-
-                if (VERBOSE)
-                    printf("%d %d %d: %s -> %s\n",
-                           CURRENT_TIME, proc->get_pid(), timeInPrevState,
-                           STATE_STRING[proc->state].c_str(), STATE_STRING[READY].c_str());
-                if (proc->state == BLOCKED) {
-                    /** perform accounting for BLOCKED to READY **/
-                    proc->io_time += timeInPrevState;
-                    BLOCKED_PROCESS_COUNT--;
-                    if (BLOCKED_PROCESS_COUNT == 0) {
-                        TIME_IO_BUSY += CURRENT_TIME - io_busy_start_time;
-                        io_busy_start_time = 0;
-                    }
-                    // reset dynamic priority
-                    proc->dynamic_priority = proc->static_priority - 1;
-                }
-
-                /** add process to run queue, no event created **/
-                proc->state_start_time = CURRENT_TIME;
-                proc->state = READY;
-
-                /** new process ready, preempt the current running process **/
-                if (SCHEDULER->test_preempt(proc, CURRENT_RUNNING_PROCESS, DISPATCHER, CURRENT_TIME)) {
-                    // remove the later events
-                    DISPATCHER->remove_events(CURRENT_RUNNING_PROCESS, CURRENT_TIME);
-
-                    // preempt the current running process
-                    Process *p = CURRENT_RUNNING_PROCESS;
-                    auto *preprio_event = new Event(p);
-                    preprio_event->timestamp = CURRENT_TIME;
-                    preprio_event->transition = TRANS_TO_PREEMPT;
-                    DISPATCHER->put_event(preprio_event);
-                }
+void benchmark_hot_path(const shared_ptr<const Workload> &workload, const char *depth_spec) {
+    const char *queues[] = {"L", "B", "P", "C"};
+    const char *schedulers[] = {"F", "L", "S", "R2", "P2", "E2", "C"};
+    const int OPS = 1 << 20;
+
+    vector<int> depths;
+    for (const char *p = depth_spec; *p;) {
+        char *end;
+        long d = strtol(p, &end, 10);
+        if (end == p || d <= 0) {
+            throw_error("Invalid queue depths <%s>", depth_spec);
+        }
+        depths.push_back((int) d);
+        p = *end == ',' ? end + 1 : end;
+    }
 
-                SCHEDULER->add_process(proc);
-                CALL_SCHEDULER = true;
-                break;
+    /** hold model: every get_event is followed by a put_event later in time **/
+    for (const char *q: queues) {
+        for (int depth: depths) {
+            if (q[0] == 'L' && depth > 100000) {
+                printf("DES   %-6s depth=%-9d skipped, linear insertion\n", q, depth);
+                continue;
             }
-            case TRANS_TO_PREEMPT: // similar to TRANS_TO_READY
-            {
-                if (proc->state != RUNNING) {
-                    printf("TRANS_TO_PREEMPT - Incorrect incoming state - %s, expected RUNNING\n",
-                           STATE_STRING[proc->state].c_str());
-                    exit(1);
-                }
-                /** perform accounting for RUNNING to PREEMPT **/
-                proc->remaining_cpu_time -= timeInPrevState;
-                proc->curr_cpu_burst -= timeInPrevState;
-
-                /** must come from RUNNING (preemption) **/
-                if (VERBOSE)
-                    printf("%d %d %d: %s -> %s  cb=%d rem=%d prio=%d\n",
-                           CURRENT_TIME, proc->get_pid(), timeInPrevState,
-                           STATE_STRING[proc->state].c_str(), STATE_STRING[READY].c_str(),
-                           proc->curr_cpu_burst, proc->remaining_cpu_time, proc->dynamic_priority);
-                if (proc == CURRENT_RUNNING_PROCESS) {
-                    CURRENT_RUNNING_PROCESS = nullptr;
-                }
-
-                /** add process to run queue, no event created **/
-                proc->dynamic_priority--;
-                proc->state_start_time = CURRENT_TIME;
-                proc->state = READY;
-
-                /** new process ready, preempt the current running process **/
-                if (SCHEDULER->test_preempt(proc, CURRENT_RUNNING_PROCESS, DISPATCHER, CURRENT_TIME)) {
-                    // remove the later events
-                    DISPATCHER->remove_events(CURRENT_RUNNING_PROCESS, CURRENT_TIME);
-
-                    // preempt the current running process
-                    Process *p = CURRENT_RUNNING_PROCESS;
-                    auto *preprio_event = new Event(p);
-                    preprio_event->timestamp = CURRENT_TIME;
-                    preprio_event->transition = TRANS_TO_PREEMPT;
-                    DISPATCHER->put_event(preprio_event);
-                }
-
-                SCHEDULER->add_process(proc);
-                CALL_SCHEDULER = true;
-                break;
+            SplitMix64 rng(depth);
+            ProcessTable table;
+            table.reserve(depth);
+            DES_Layer des(getEventQueue(q));
+            for (int i = 0; i < depth; i++) {
+                des.put_event(table.add(ProcessSpec{0, 1, 1, 1}), (int) (rng.next() % (2 * (uint64_t) depth)),
+                              TRANS_TO_READY);
             }
-            case TRANS_TO_RUN: {
-                if (proc->state != READY) {
-                    printf("TRANS_TO_RUN - Incorrect incoming state - %s, expected READY\n",
-                           STATE_STRING[proc->state].c_str());
-                    exit(1);
-                }
-                /** perform accounting READY to RUNNING **/
-                proc->cpu_wait_time += timeInPrevState;
-
-                /** calculations for new state **/
-                if (proc->curr_cpu_burst == 0) {
-                    int cb = get_random(proc->cpu_burst);
-                    if (proc->remaining_cpu_time < cb)
-                        cb = proc->remaining_cpu_time;
-                    proc->curr_cpu_burst = cb;
-                }
-                CURRENT_RUNNING_PROCESS = proc;
-
-                /** create event for either preemption or blocking */
-                if (SCHEDULER->get_quant() < proc->curr_cpu_burst) {
-                    /** create event for preemption **/
-                    auto *preempt_event = new Event(proc);
-                    preempt_event->timestamp = CURRENT_TIME + SCHEDULER->get_quant();
-                    preempt_event->transition = TRANS_TO_PREEMPT;
-                    DISPATCHER->put_event(preempt_event);
-                } else if (proc->curr_cpu_burst == proc->remaining_cpu_time) {
-                    /** create event for done **/
-                    auto *done_event = new Event(proc);
-                    done_event->timestamp = CURRENT_TIME + proc->curr_cpu_burst;
-                    done_event->transition = TRANS_TO_DONE;
-                    DISPATCHER->put_event(done_event);
-                } else {
-                    /** create event for blocking **/
-                    auto *block_event = new Event(proc);
-                    block_event->timestamp = CURRENT_TIME + proc->curr_cpu_burst;
-                    block_event->transition = TRANS_TO_BLOCK;
-                    DISPATCHER->put_event(block_event);
-                }
-
-                if (VERBOSE)
-                    printf("%d %d %d: %s -> %s cb=%d rem=%d prio=%d\n",
-                           CURRENT_TIME, proc->get_pid(), timeInPrevState,
-                           STATE_STRING[proc->state].c_str(), STATE_STRING[RUNNING].c_str(),
-                           proc->curr_cpu_burst, proc->remaining_cpu_time, proc->dynamic_priority);
-
-                proc->state_start_time = CURRENT_TIME;
-                proc->state = RUNNING;
-
-                CALL_SCHEDULER = true;
-                break;
+            auto start = chrono::steady_clock::now();
+            Event e{};
+            for (int i = 0; i < OPS; i++) {
+                des.get_event(e);
+                des.put_event(table.get(e.slot), e.timestamp + (int) (rng.next() % (2 * (uint64_t) depth)),
+                              TRANS_TO_READY);
             }
-            case TRANS_TO_BLOCK: {
-                if (proc->state != RUNNING) {
-                    printf("TRANS_TO_BLOCK - Incorrect incoming state - %s, expected RUNNING\n",
-                           STATE_STRING[proc->state].c_str());
-                    exit(1);
-                }
-
-                /** perform accounting RUNNING to BLOCK **/
-                proc->remaining_cpu_time -= timeInPrevState;
-                proc->curr_cpu_burst = 0;
-                CURRENT_RUNNING_PROCESS = nullptr;
-
-                /** calculations for new state **/
-                int ib = get_random(proc->io_burst);
-                BLOCKED_PROCESS_COUNT++;
-                if (BLOCKED_PROCESS_COUNT == 1) {
-                    io_busy_start_time = CURRENT_TIME;
-                }
-
-                /** create an event for when process becomes READY again **/
-                auto *ready_event = new Event(proc);
-                ready_event->timestamp = CURRENT_TIME + ib;
-                ready_event->transition = TRANS_TO_READY;
-                DISPATCHER->put_event(ready_event);
-
-                if (VERBOSE)
-                    printf("%d %d %d: %s -> %s  ib=%d rem=%d\n",
-                           CURRENT_TIME, proc->get_pid(), timeInPrevState,
-                           STATE_STRING[proc->state].c_str(), STATE_STRING[BLOCKED].c_str(),
-                           ib, proc->remaining_cpu_time);
-
-                proc->state_start_time = CURRENT_TIME;
-                proc->state = BLOCKED;
+            chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+            printf("DES   %-6s depth=%-9d %9.1f ns/op %13.0f ops/sec\n", q, depth,
+                   elapsed.count() / OPS, OPS / elapsed.count() * 1e9);
+        }
+    }
 
-                CALL_SCHEDULER = true;
-                break;
+    /** steady state: take the next process and put it back as if preempted **/
+    for (const char *spec: schedulers) {
+        for (int depth: depths) {
+            SplitMix64 rng(depth);
+            Scheduler *s = getScheduler(spec);
+            ProcessTable table;
+            table.reserve(depth);
+            for (int i = 0; i < depth; i++) {
+                Process *p = table.add(ProcessSpec{0, 1 + (int) (rng.next() % 1000), 1, 1});
+                p->static_priority = 1 + (int) (rng.next() % s->get_maxprio());
+                p->dynamic_priority = p->static_priority - 1;
+                s->add_process(p);
             }
-            case TRANS_TO_DONE: {
-                if (proc->state != RUNNING) {
-                    printf("TRANS_TO_DONE - Incorrect incoming state - %s, expected RUNNING\n",
-                           STATE_STRING[proc->state].c_str());
-                    exit(1);
-                }
-
-                /** perform accounting RUNNING to DONE **/
-                proc->finishing_time = CURRENT_TIME;
-                CURRENT_RUNNING_PROCESS = nullptr;
-
-                if (VERBOSE)
-                    printf("%d %d %d: Done\n", CURRENT_TIME, proc->get_pid(), timeInPrevState);
-                CALL_SCHEDULER = true;
-                break;
+            auto start = chrono::steady_clock::now();
+            for (int i = 0; i < OPS; i++) {
+                Process *p = s->get_next_process();
+                p->dynamic_priority--;
+                if (p->dynamic_priority < 0)
+                    p->dynamic_priority = p->static_priority - 1;
+                p->remaining_cpu_time = 1 + (int) (rng.next() % 1000);
+                s->add_process(p);
             }
+            chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+            printf("SCHED %-6s depth=%-9d %9.1f ns/op %13.0f ops/sec\n", spec, depth,
+                   elapsed.count() / OPS, OPS / elapsed.count() * 1e9);
+            delete s;
         }
+    }
 
-        if (CALL_SCHEDULER) {
-            if (DISPATCHER->get_next_event_time() == CURRENT_TIME)
-                continue;           // process next event from Event queue
-            CALL_SCHEDULER = false; // reset global flag
-            if (CURRENT_RUNNING_PROCESS == nullptr) {
-                CURRENT_RUNNING_PROCESS = SCHEDULER->get_next_process();
-                if (CURRENT_RUNNING_PROCESS == nullptr)
-                    continue;
-
-                /** create event to make this process runnable for same time **/
-                auto *run_event = new Event(CURRENT_RUNNING_PROCESS);
-                run_event->timestamp = CURRENT_TIME;
-                run_event->transition = TRANS_TO_RUN;
-                DISPATCHER->put_event(run_event);
-            }
-        }
+    Simulator simulator(workload);
+    for (const char *spec: schedulers) {
+        auto start = chrono::steady_clock::now();
+        unsigned long long events = simulator.run(cli_options(spec)).events;
+        chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+        printf("RUN   %-6s events=%-10llu %9.1f ns/event %11.0f events/sec\n", spec, events,
+               elapsed.count() / (double) events, (double) events / elapsed.count() * 1e9);
     }
 }
 
@@ -884,8 +5135,16 @@ void run_simulation() {
  * @param - argv - array of arguments
  */
 void read_arguments(int argc, char **argv) {
+    static const struct option long_options[] = {
+            {"checkpoint-every", required_argument, nullptr, 'K'},
+            {"checkpoint-file",  required_argument, nullptr, 'F'},
+            {"restore",          required_argument, nullptr, 'R'},
+            {"replications",     required_argument, nullptr, 'N'},
+            {"replay",           required_argument, nullptr, 'r'},
+            {"prng",             required_argument, nullptr, 'x'},
+            {nullptr, 0,                            nullptr, 0}};
     int option;
-    while ((option = getopt(argc, argv, "vtepis:")) != -1) {
+    while ((option = getopt_long(argc, argv, "vtepis:q:ac:b:S:j:lB:C:ko:d:G:T:AK:F:R:QD:N:r:X:x:", long_options, nullptr)) != -1) {
         switch (option) {
             case 'v':
                 VERBOSE = true;
@@ -902,8 +5161,115 @@ void read_arguments(int argc, char **argv) {
             case 'i':
                 SHOW_SINGLE_STEP = true;
                 break;
+            case 'a':
+                SHOW_ALLOC_STATS = true;
+                break;
             case 's': {
-                SCHEDULER = getScheduler(optarg);
+                delete getScheduler(optarg);
+                SCHEDULER_SPEC = optarg;
+                break;
+            }
+            case 'q': {
+                delete getEventQueue(optarg);
+                EVENT_QUEUE_SPEC = optarg;
+                break;
+            }
+            case 'c': {
+                NUM_CPUS = atoi(optarg);
+                if (NUM_CPUS <= 0) {
+                    throw_error("Invalid number of CPUs <%s>", optarg);
+                }
+                break;
+            }
+            case 'b': {
+                Balance_Policy policy;
+                int interval;
+                get_balance_policy(optarg, policy, interval);
+                BALANCE_SPEC = optarg;
+                break;
+            }
+            case 'S': {
+                SWEEP_SPEC = optarg;
+                break;
+            }
+            case 'j': {
+                SWEEP_THREADS = atoi(optarg);
+                break;
+            }
+            case 'l':
+                STREAM_LOADER = true;
+                break;
+            case 'C':
+                CONVERT_TO = optarg;
+                break;
+            case 'k':
+                USE_BINARY_CACHE = true;
+                break;
+            case 'o':
+                TRACE_FILE = optarg;
+                SHOW_EVENT_TRACE = true;
+                break;
+            case 'd':
+                DECODE_TRACE = optarg;
+                break;
+            case 'G':
+                GENERATE_SPEC = optarg;
+                break;
+            case 'T':
+                BENCH_DEPTHS = optarg;
+                break;
+            case 'A':
+                STREAM_ARRIVALS = true;
+                break;
+            case 'K': {
+                CHECKPOINT_EVERY = strtoull(optarg, nullptr, 10);
+                if (CHECKPOINT_EVERY == 0) {
+                    throw_error("Invalid checkpoint interval <%s>", optarg);
+                }
+                break;
+            }
+            case 'F':
+                CHECKPOINT_FILE = optarg;
+                break;
+            case 'Q':
+                SHOW_PERCENTILES = true;
+                break;
+            case 'D': {
+                vector<IODevice> devices;
+                get_io_devices(optarg, devices);
+                IO_DEVICE_SPEC = optarg;
+                break;
+            }
+            case 'R':
+                RESTORE_FILE = optarg;
+                break;
+            case 'r':
+                REPLAY_FILE = optarg;
+                break;
+            case 'X':
+                CONVERT_BURSTS = optarg;
+                break;
+            case 'x': {
+                char *end;
+                PRNG_SEED = strtoull(optarg, &end, 0);
+                if (end == optarg || *end != '\0') {
+                    throw_error("Invalid generator seed <%s>", optarg);
+                }
+                USE_PRNG = true;
+                break;
+            }
+            case 'N': {
+                REPLICATIONS = atoi(optarg);
+                if (REPLICATIONS < 2) {
+                    throw_error("Invalid number of replications <%s>, at least 2 are needed", optarg);
+                }
+                break;
+            }
+            case 'B': {
+                LOADER_BENCH_ROUNDS = atoi(optarg);
+                if (LOADER_BENCH_ROUNDS <= 0) {
+                    throw_error("Invalid number of rounds <%s>", optarg);
+                }
                 break;
             }
             default:
@@ -912,76 +5278,300 @@ void read_arguments(int argc, char **argv) {
         }
     }
 
+    if (DECODE_TRACE) {
+        return;
+    }
+
+    if (CONVERT_BURSTS) {
+        if (argc != optind + 1) {
+            throw_error("-X converts one burst listing, usage: -X out.bursts listing.txt");
+        }
+        return;
+    }
+
     if (argc == optind) {
-        printf("Not a valid inputfile <(null)>\n");
-        exit(1);
+        throw_error("Not a valid inputfile <(null)>");
+    }
+
+    if (argc == optind + 1 && !has_suffix(argv[optind], ".bin")) {
+        throw_error("Not a valid random file <(null)>");
+    }
+
+    if (STREAM_ARRIVALS && (SWEEP_SPEC || CONVERT_TO || BENCH_DEPTHS || LOADER_BENCH_ROUNDS)) {
+        throw_error("-A streams the arrivals of a single run, it cannot be combined with -S, -C, -T or -B");
+    }
+
+    if ((CHECKPOINT_EVERY || RESTORE_FILE) && (SWEEP_SPEC || CONVERT_TO || BENCH_DEPTHS || LOADER_BENCH_ROUNDS)) {
+        throw_error("Checkpoints belong to a single run, they cannot be combined with -S, -C, -T or -B");
+    }
+
+    if (REPLICATIONS && (SWEEP_SPEC || STREAM_ARRIVALS || CHECKPOINT_EVERY || RESTORE_FILE)) {
+        throw_error("Replications repeat one configuration, they cannot be combined with -S, -A or checkpoints");
     }
 
-    if (argc == optind + 1) {
-        printf("Not a valid random file <(null)>\n");
-        exit(1);
+    if (SHOW_ALLOC_STATS && (SWEEP_SPEC || REPLICATIONS || BENCH_DEPTHS || CONVERT_TO || LOADER_BENCH_ROUNDS ||
+                             STREAM_ARRIVALS || RESTORE_FILE)) {
+        throw_error("-a repeats a single run, it cannot be combined with -S, -N, -T, -C, -B, -A or --restore");
     }
 
-    if (!SCHEDULER) {
-        SCHEDULER = new FCFSScheduler();
+    if (SHOW_EVENT_TRACE && (SWEEP_SPEC || REPLICATIONS || BENCH_DEPTHS || CONVERT_TO || LOADER_BENCH_ROUNDS)) {
+        throw_error("-e and -o trace a single run, they cannot be combined with -S, -N, -T, -C or -B");
+    }
+
+    if ((VERBOSE || SHOW_SCHED_DETAILS) && (SWEEP_SPEC || REPLICATIONS)) {
+        throw_error("-v and -t describe a single run, they cannot be combined with -S or -N");
     }
 }
 
 /**
- * Print the scheduling output in the format expected for grading
+ * Carry out the command line, errors reach main as exceptions
  */
-void print_output() {
-    printf("%s\n", SCHEDULER->to_string().c_str());
+void run_command_line(int argc, char **argv) {
+    read_arguments(argc, argv);
 
-    int time_cpu_busy = 0;
-    int num_processes = 0;
-    int total_turnaround = 0;
-    int total_cpu_wait = 0;
-    int finish_time = CURRENT_TIME;
+    if (DECODE_TRACE) {
+        decode_trace(DECODE_TRACE);
+        return;
+    }
 
-    for (Process *p: PROCESSES) {
-        int turnaround_time = p->finishing_time - p->arrival_time;
-        printf("%04d: %4d %4d %4d %4d %1d | %5d %5d %5d %5d\n",
-               p->get_pid(), p->arrival_time, p->total_cpu_time, p->cpu_burst, p->io_burst,
-               p->static_priority, p->finishing_time, turnaround_time, p->io_time, p->cpu_wait_time);
+    if (GENERATE_SPEC) {
+        GeneratorSpec spec;
+        if (!spec.parse(GENERATE_SPEC)) {
+            throw_error("Invalid generator spec <%s>", GENERATE_SPEC);
+        }
+        generate_workload(spec, argv[optind], argv[optind + 1]);
+        printf("Wrote %s: %llu processes %u randoms\n", argv[optind], (unsigned long long) spec.count,
+               spec.rand_count);
+        return;
+    }
 
-        total_turnaround += turnaround_time;
-        total_cpu_wait += p->cpu_wait_time;
-        time_cpu_busy += turnaround_time - p->io_time - p->cpu_wait_time;
-        num_processes += 1;
+    if (CONVERT_BURSTS) {
+        BurstHeader header{};
+        if (!write_bursts(argv[optind], CONVERT_BURSTS, header)) {
+            throw_error("Cannot convert burst listing <%s> into <%s>", argv[optind], CONVERT_BURSTS);
+        }
+        printf("Wrote %s: %llu processes %llu burst pairs\n", CONVERT_BURSTS,
+               (unsigned long long) header.process_count, (unsigned long long) header.pair_count);
+        return;
     }
 
-    double cpu_util = 100.0 * (time_cpu_busy / (double) finish_time);
-    double io_util = 100.0 * (TIME_IO_BUSY / (double) finish_time);
-    double avg_turnaround_time = (total_turnaround / (double) num_processes);
-    double avg_cpu_wait_time = (total_cpu_wait / (double) num_processes);
-    double throughput = 100.0 * (num_processes / (double) finish_time);
+    if (LOADER_BENCH_ROUNDS) {
+        benchmark_loaders(argv[optind], argv[optind + 1], LOADER_BENCH_ROUNDS);
+        return;
+    }
 
-    printf("SUM: %d %.2lf %.2lf %.2lf %.2lf %.3lf\n",
-           finish_time, cpu_util, io_util, avg_turnaround_time, avg_cpu_wait_time, throughput);
+    auto workload = make_shared<Workload>();
+    if (has_suffix(argv[optind], ".bin")) {
+        load_binary(argv[optind], *workload);
+    } else if (STREAM_ARRIVALS) {
+        /** only the random numbers are loaded, the processes are read as they arrive **/
+        parse_randoms_mmap(argv[optind + 1], *workload);
+        workload->arrival_input = argv[optind];
+    } else if (USE_BINARY_CACHE) {
+        load_cached(argv[optind], argv[optind + 1], *workload);
+    } else if (STREAM_LOADER) {
+        parse_randoms(argv[optind + 1], *workload);
+        load_processes(argv[optind], *workload);
+    } else {
+        parse_randoms_mmap(argv[optind + 1], *workload);
+        load_processes_mmap(argv[optind], *workload);
+    }
+
+    BurstTrace replay;
+    if (REPLAY_FILE) {
+        if (!replay.open(REPLAY_FILE)) {
+            throw_error("Not a valid burst replay file <%s>", REPLAY_FILE);
+        }
+        workload->replay = &replay;
+    }
+
+    if (CONVERT_TO) {
+        if (has_suffix(argv[optind], ".bin") ||
+            !write_binary(CONVERT_TO, *workload, argv[optind], argv[optind + 1])) {
+            throw_error("Cannot write binary workload <%s>", CONVERT_TO);
+        }
+        printf("Wrote %s: %zu processes %zu randoms\n", CONVERT_TO, workload->process_count, workload->rand_count);
+        return;
+    }
+
+    if (BENCH_DEPTHS) {
+        benchmark_hot_path(workload, BENCH_DEPTHS);
+        return;
+    }
+
+    if (SWEEP_SPEC) {
+        run_sweep(workload);
+        return;
+    }
+
+    if (REPLICATIONS) {
+        run_replications(workload, REPLICATIONS);
+        return;
+    }
+
+    SimulationOptions options = cli_options(SCHEDULER_SPEC);
+    options.per_process = true;
+    Simulator simulator(workload);
+    SimulationResults results = simulator.run(options);
+    print_output(results);
+    if (SHOW_PERCENTILES)
+        print_percentiles("", results.turnaround, results.ready_wait, results.response);
+    if (NUM_CPUS > 1)
+        print_cpu_stats(results);
+    if (IO_DEVICE_SPEC)
+        print_io_stats(results);
+    if (SHOW_SCHED_DETAILS)
+        simulator.print_sched_stats();
+    if (SHOW_ALLOC_STATS) {
+        /** the first run grows the queues to their size, a plain repeat on the same simulation shows the steady state **/
+        SimulationOptions repeat = options;
+        repeat.per_process = repeat.verbose = false;
+        repeat.trace_file.clear();
+        repeat.checkpoint_every = 0;
+        SimulationResults steady = simulator.run(repeat);
+        printf("ALLOC: event_bytes=%llu warmup_heap_allocs=%llu steady_heap_allocs=%llu\n",
+               results.event_bytes, results.heap_allocations, steady.heap_allocations);
+    }
 }
 
+#endif
+
+}  // namespace
+
 /**
- * Deallocate memory used in the program
+ * The simulation of the last run, and the arrivals it streams
  */
-void garbage_collection() {
-    delete SCHEDULER;
-    delete DISPATCHER;
+struct Simulator::State {
+    SimulationContext *context = nullptr;
+    unique_ptr<ArrivalCursor> arrivals;
 
-    for (Process *p: PROCESSES)
-        delete p;
+    ~State() {
+        delete context;
+    }
+};
+
+Simulator::Simulator(shared_ptr<const Workload> loaded) : workload(std::move(loaded)) {
 }
 
-int main(int argc, char **argv) {
-    read_arguments(argc, argv);
-    parse_randoms(argv[optind + 1]);
-    load_processes(argv[optind]);
+Simulator::Simulator(const Simulator &other) : workload(other.workload) {
+}
+
+void Simulator::load(const char *inputfile, const char *randfile) {
+    auto loaded = make_shared<Workload>();
+    parse_randoms_mmap(const_cast<char *>(randfile), *loaded);
+    load_processes_mmap(const_cast<char *>(inputfile), *loaded);
+    delete state;
+    state = nullptr;
+    workload = loaded;
+}
+
+void Simulator::load(const char *binfile) {
+    auto loaded = make_shared<Workload>();
+    load_binary(const_cast<char *>(binfile), *loaded);
+    delete state;
+    state = nullptr;
+    workload = loaded;
+}
+
+SimulationResults Simulator::run(const SimulationOptions &options) {
+    if (!workload) {
+        throw_error("No workload loaded");
+    }
+    if (!options.stream_arrivals && !workload->arrival_input.empty()) {
+        throw_error("The processes of <%s> are only read by streamed runs", workload->arrival_input.c_str());
+    }
+    if (!state)
+        state = new State();
+    SimulationContext *&context = state->context;
+
+    if (context && !options.stream_arrivals && context->same_shape(options)) {
+        context->reset(options);
+    } else {
+        delete context;
+        context = nullptr;
+        if (options.stream_arrivals) {
+            /** a new cursor, every streamed run reads the input from its start **/
+            state->arrivals.reset(new ArrivalCursor());
+            if (workload->arrival_input.empty())
+                state->arrivals->open(*workload);
+            else if (!state->arrivals->open(workload->arrival_input.c_str()))
+                throw_error("Not a valid inputfile <%s>", workload->arrival_input.c_str());
+        }
+        context = new SimulationContext(workload.get(), options,
+                                        options.stream_arrivals ? state->arrivals.get() : nullptr);
+    }
+    if (!options.restore_file.empty())
+        context->restore(options.restore_file.c_str());
+
+    TraceWriter trace;
+    if (!options.trace_file.empty() && !trace.open(options.trace_file.c_str())) {
+        throw_error("Cannot write trace file <%s>", options.trace_file.c_str());
+    }
+    context->set_trace(options.trace_file.empty() ? nullptr : &trace);
+    try {
+        context->run();
+    } catch (...) {
+        COUNT_ALLOCATIONS = false;
+        context->set_trace(nullptr);
+        throw;
+    }
+    context->set_trace(nullptr);
+    if (!trace.close()) {
+        throw_error("Cannot write trace file <%s>", options.trace_file.c_str());
+    }
+    return context->results();
+}
 
-    DISPATCHER = new DES_Layer();
-    DISPATCHER->initialize(PROCESSES);
-    run_simulation();
+void Simulator::print_sched_stats() const {
+    if (state && state->context)
+        state->context->print_sched_stats();
+}
+
+Simulator::~Simulator() {
+    delete state;
+}
+
+void pool_percentiles(const vector<SimulationResults> &runs, SimulationResults &pooled) {
+    LatencyStats latency;
+    for (const SimulationResults &run: runs) {
+        if (run.latency)
+            latency.merge(*run.latency);
+    }
+    pooled.turnaround = latency.turnaround.percentiles();
+    pooled.ready_wait = latency.ready_wait.percentiles();
+    pooled.response = latency.response.percentiles();
+}
+
+#ifndef SCHEDULER_LIBRARY
+/**
+ * Count the heap allocations of event loops for -a, other code only pays the
+ * test of a thread-local flag. Kept out of line, as inlined next to a new
+ * expression the free in operator delete reads as a mismatched deallocation.
+ */
+__attribute__((noinline)) void *operator new(size_t size) {
+    if (COUNT_ALLOCATIONS)
+        HEAP_ALLOCATIONS++;
+    void *p = malloc(size ? size : 1);
+    if (p == nullptr)
+        throw bad_alloc();
+    return p;
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept {
+    free(p);
+}
 
-    print_output();
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
 
-    garbage_collection();
-}
\ No newline at end of file
+int main(int argc, char **argv) {
+    try {
+        run_command_line(argc, argv);
+    } catch (const exception &e) {
+        printf("%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,174 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+/**
+ * Library interface of the simulator. Build scheduler.cpp with
+ * -DSCHEDULER_LIBRARY to leave out the command line entry point and the
+ * allocation counting operator new, then link it into the host program.
+ * Unreadable files, invalid specs and checkpoints that do not fit throw
+ * std::runtime_error with the message the command line prints.
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Settings of one simulation, the options of a single command line run
+ */
+struct SimulationOptions {
+    std::string scheduler = "F";            // sched spec, e.g. "R4", "E5:3" or "C20:2"
+    std::string event_queue = "B";          // L, B, P or C
+    int cpus = 1;                           // simulated CPUs
+    std::string balance = "S";              // G, S or R<interval>, used with several CPUs
+    std::string io_devices;                 // comma separated IO devices, empty keeps IO infinitely parallel
+    unsigned long long random_offset = 0;   // random file offset of the first draw, the stream index with prng
+    bool prng = false;                      // draw from the built-in xoshiro256++ stream instead of the random file
+    unsigned long long seed = 0;            // seed of that stream
+    bool per_process = false;               // fill SimulationResults::processes
+    bool stream_arrivals = false;           // -A: create processes as they arrive, the input must be sorted
+    bool verbose = false;                   // -v: print every transition
+    bool sched_stats = false;               // -t: collect the counters printed by Simulator::print_sched_stats
+    bool keep_latency = false;              // keep the distributions behind the percentiles, see pool_percentiles
+    std::string trace_file;                 // -e/-o: write every transition to this binary trace, empty for none
+    unsigned long long checkpoint_every = 0; // --checkpoint-every: events between checkpoints, 0 for none
+    std::string checkpoint_file = "scheduler.ckpt";
+    std::string restore_file;               // --restore: continue from this checkpoint, empty starts anew
+};
+
+/**
+ * Aggregate results printed on the SUM line
+ */
+struct Summary {
+    int finish_time;
+    double cpu_util;
+    double io_util;
+    double avg_turnaround_time;
+    double avg_cpu_wait_time;
+    double throughput;
+};
+
+/**
+ * One per-process line of the output
+ */
+struct ProcessResult {
+    int pid;
+    int arrival_time;
+    int total_cpu_time;
+    int cpu_burst;
+    int io_burst;
+    int static_priority;
+    int finishing_time;
+    int turnaround_time;
+    int io_time;
+    int cpu_wait_time;
+};
+
+struct CpuResult {
+    double util;            // share of the run spent running processes, in percent
+    int dispatches;
+    int migrations;         // dispatches of a process that last ran on another CPU
+    int steals;             // processes taken from another CPU's run queue
+};
+
+struct IODeviceResult {
+    std::string spec;       // e.g. "D2:50"
+    double util;            // share of channel time in use, in percent
+    double busy;            // share of time with any request in service, in percent
+    unsigned long long requests;
+    unsigned long long queued; // requests that waited for a channel
+    double avg_wait;        // over the queued requests
+    int max_wait;
+    int max_queue;
+};
+
+struct Percentiles {
+    int p50, p90, p99, p999, max;
+};
+
+struct LatencyStats;
+
+/**
+ * Everything a run reports, in the units of the command line output
+ */
+struct SimulationResults {
+    std::string scheduler;                  // name printed above the process lines, e.g. "PRIO 4"
+    Summary sum;
+    unsigned long long events;              // events put into the event queue
+    unsigned long long event_bytes;         // storage held by the event queue
+    unsigned long long heap_allocations;    // operator new calls of the event loop, counted by the command line build
+    Percentiles turnaround;                 // arrival to finish
+    Percentiles ready_wait;                 // total time in the ready queue
+    Percentiles response;                   // arrival to first dispatch
+    std::vector<CpuResult> cpus;
+    std::vector<IODeviceResult> io_devices;
+    std::vector<ProcessResult> processes;   // in pid order, only with SimulationOptions::per_process
+    std::shared_ptr<const LatencyStats> latency; // only with SimulationOptions::keep_latency
+};
+
+/**
+ * Percentiles over the finished processes of several runs taken together,
+ * e.g. the replications of one configuration
+ * @param - runs - results of runs made with SimulationOptions::keep_latency
+ * @param - pooled - receives turnaround, ready_wait and response
+ */
+void pool_percentiles(const std::vector<SimulationResults> &runs, SimulationResults &pooled);
+
+class Workload;
+
+/**
+ * Runs simulations on a workload loaded once, so a rerun does not parse the
+ * input again. The state of the last run is kept: when the next run has the
+ * same CPU count, balance policy, event queue and IO devices, its process
+ * table, event queue, run queues and IO queues are reset in place and keep
+ * their capacity, and the schedulers are kept when the sched spec is the
+ * same too. Other runs, streamed ones and the results still allocate.
+ * A copy shares the loaded workload but not the simulation state, so
+ * threads can run scenarios on one workload with a copy each.
+ */
+class Simulator {
+private:
+    struct State;
+    std::shared_ptr<const Workload> workload;
+    State *state = nullptr;                 // simulation of the last run
+
+public:
+    Simulator() = default;
+
+    /**
+     * Run simulations on a workload the command line loaders filled in
+     */
+    explicit Simulator(std::shared_ptr<const Workload> loaded);
+
+    /**
+     * Share the workload of other, the copy starts without simulation state
+     */
+    Simulator(const Simulator &other);
+
+    Simulator &operator=(const Simulator &) = delete;
+
+    /**
+     * Load a text input file and random-number file
+     */
+    void load(const char *inputfile, const char *randfile);
+
+    /**
+     * Map a binary workload written by -C or -G
+     */
+    void load(const char *binfile);
+
+    /**
+     * Run one simulation of the loaded workload
+     */
+    SimulationResults run(const SimulationOptions &options);
+
+    /**
+     * Print the event, event queue and run queue counters of the last run,
+     * which collects them with SimulationOptions::sched_stats
+     */
+    void print_sched_stats() const;
+
+    ~Simulator();
+};
+
+#endif // SCHEDULER_H